@@ -0,0 +1,400 @@
+#include <core/classifier.h>
+#include <core/data.h>
+#include <core/training_model.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Benchmarks parsing, training, saving, loading and classifying on a
+// synthetic data set, and prints the results as JSON. Run with --help for the
+// options.
+
+namespace {
+
+struct BenchConfig {
+  size_t number_of_images = 20000;
+  size_t image_size = 28;
+  size_t number_of_classes = 10;
+  size_t number_of_threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t repetitions = 5;
+  unsigned seed = 42;
+  std::string work_directory = ".";
+  std::string output_path;
+  std::string baseline_path;
+  double tolerance = 0.10;
+};
+
+/**
+ * One measured number.
+ */
+struct Metric {
+  std::string name;
+  double value;
+  // whether a larger value is an improvement
+  bool higher_is_better;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * Runs a function several times and returns the median time in seconds.
+ */
+double MedianSeconds(size_t repetitions, const std::function<void()> &run) {
+  std::vector<double> times;
+  for (size_t i = 0; i < std::max<size_t>(repetitions, 1); i++) {
+    Clock::time_point start = Clock::now();
+    run();
+    times.push_back(SecondsSince(start));
+  }
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+double Percentile(std::vector<double> sorted_values, double fraction) {
+  if (sorted_values.empty()) {
+    return 0.0;
+  }
+  size_t index = (size_t)(fraction * (sorted_values.size() - 1) + 0.5);
+  return sorted_values[index];
+}
+
+/**
+ * Writes a data set in the label + N-lines format. Every class has its own
+ * random shading probability per pixel, so the classes can be told apart.
+ */
+std::string MakeDataSet(const BenchConfig &config) {
+  std::mt19937 generator(config.seed);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  size_t number_of_pixels = config.image_size * config.image_size;
+
+  std::vector<double> shading(config.number_of_classes * number_of_pixels);
+  for (double &probability : shading) {
+    probability = uniform(generator) * uniform(generator);
+  }
+
+  std::string text;
+  text.reserve(config.number_of_images *
+               (number_of_pixels + config.image_size + 8));
+  for (size_t i = 0; i < config.number_of_images; i++) {
+    size_t label = generator() % config.number_of_classes;
+    text += std::to_string(label);
+    text += '\n';
+    const double *class_shading = &shading[label * number_of_pixels];
+    for (size_t row = 0; row < config.image_size; row++) {
+      for (size_t col = 0; col < config.image_size; col++) {
+        double value = uniform(generator);
+        double probability = class_shading[row * config.image_size + col];
+        text += value < probability / 2 ? '+' : value < probability ? '#' : ' ';
+      }
+      text += '\n';
+    }
+  }
+  return text;
+}
+
+std::vector<Metric> RunBenchmarks(const BenchConfig &config) {
+  std::vector<Metric> metrics;
+  std::string text = MakeDataSet(config);
+  double megabytes = text.size() / (1024.0 * 1024.0);
+  std::string data_path = config.work_directory + "/bench_data.txt";
+  std::string text_model_path = config.work_directory + "/bench_model.txt";
+  std::string binary_model_path = config.work_directory + "/bench_model.nbm";
+  {
+    std::ofstream file(data_path, std::ios::binary);
+    file.write(text.data(), text.size());
+  }
+
+  // parse
+  double parse_seconds = MedianSeconds(config.repetitions, [&] {
+    naivebayes::Data data(config.image_size);
+    data.ParseBuffer(text.data(), text.data() + text.size());
+  });
+  metrics.push_back({"parse_mb_per_s", megabytes / parse_seconds, true});
+
+  double parallel_parse_seconds = MedianSeconds(config.repetitions, [&] {
+    naivebayes::Data data(config.image_size);
+    data.ParseBuffer(text.data(), text.data() + text.size(),
+                     config.number_of_threads);
+  });
+  metrics.push_back(
+      {"parallel_parse_mb_per_s", megabytes / parallel_parse_seconds, true});
+
+  double load_file_seconds = MedianSeconds(config.repetitions, [&] {
+    naivebayes::Data data(config.image_size);
+    data.LoadFile(data_path, config.number_of_threads);
+  });
+  metrics.push_back(
+      {"load_file_mb_per_s", megabytes / load_file_seconds, true});
+
+  // train
+  naivebayes::Data data(config.image_size);
+  data.ParseBuffer(text.data(), text.data() + text.size());
+
+  double train_seconds = MedianSeconds(config.repetitions, [&] {
+    naivebayes::TrainingModel model(data);
+  });
+  metrics.push_back({"train_ms", train_seconds * 1e3, false});
+
+  double parallel_train_seconds = MedianSeconds(config.repetitions, [&] {
+    naivebayes::TrainingModel model(data, config.number_of_threads,
+                                    naivebayes::kBitSlicedCounting);
+  });
+  metrics.push_back(
+      {"parallel_train_ms", parallel_train_seconds * 1e3, false});
+
+  double stream_train_seconds = MedianSeconds(config.repetitions, [&] {
+    naivebayes::TrainingModel model(config.image_size);
+    model.TrainFile(data_path, config.number_of_threads);
+  });
+  metrics.push_back({"file_train_ms", stream_train_seconds * 1e3, false});
+
+  // save and load
+  naivebayes::TrainingModel model(data);
+  double save_text_seconds = MedianSeconds(config.repetitions, [&] {
+    model.SaveTextModel(text_model_path);
+  });
+  metrics.push_back({"save_text_model_ms", save_text_seconds * 1e3, false});
+
+  double load_text_seconds = MedianSeconds(config.repetitions, [&] {
+    naivebayes::TrainingModel loaded(config.image_size);
+    loaded.LoadTextModel(text_model_path);
+  });
+  metrics.push_back({"load_text_model_ms", load_text_seconds * 1e3, false});
+
+  double save_binary_seconds = MedianSeconds(config.repetitions, [&] {
+    model.SaveModelFile(binary_model_path);
+  });
+  metrics.push_back(
+      {"save_binary_model_ms", save_binary_seconds * 1e3, false});
+
+  double load_binary_seconds = MedianSeconds(config.repetitions, [&] {
+    naivebayes::Classifier loaded(binary_model_path);
+  });
+  metrics.push_back(
+      {"load_binary_model_ms", load_binary_seconds * 1e3, false});
+
+  // classify
+  naivebayes::Classifier classifier(binary_model_path);
+  naivebayes::ImageList images = data.GetImages();
+  std::vector<double> latencies;
+  latencies.reserve(images.size());
+  size_t correct = 0;
+  for (const naivebayes::Image &image : images) {
+    Clock::time_point start = Clock::now();
+    int prediction = classifier.Classify(image);
+    latencies.push_back(SecondsSince(start) * 1e6);
+    correct += prediction == (int)image.GetLabel();
+  }
+  std::sort(latencies.begin(), latencies.end());
+  metrics.push_back({"classify_latency_p50_us", Percentile(latencies, 0.5),
+                     false});
+  metrics.push_back({"classify_latency_p99_us", Percentile(latencies, 0.99),
+                     false});
+
+  std::vector<int> predictions(images.size());
+  naivebayes::BatchScratch scratch;
+  double batch_seconds = MedianSeconds(config.repetitions, [&] {
+    classifier.ClassifyBatch(images[0].GetWords(), images.size(),
+                             predictions.data(), scratch);
+  });
+  metrics.push_back(
+      {"batch_classify_images_per_s", images.size() / batch_seconds, true});
+  metrics.push_back(
+      {"training_accuracy", (double)correct / images.size(), true});
+
+  std::remove(data_path.c_str());
+  std::remove(text_model_path.c_str());
+  std::remove(binary_model_path.c_str());
+  return metrics;
+}
+
+/**
+ * Reads the metrics of an earlier run from its JSON output.
+ *
+ * @return value of each metric that is present, or NAN
+ */
+std::vector<double> ReadBaseline(const std::string &path,
+                                 const std::vector<Metric> &metrics) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    throw std::invalid_argument("could not open baseline: " + path);
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  std::string json = buffer.str();
+
+  std::vector<double> values;
+  for (const Metric &metric : metrics) {
+    size_t key = json.find("\"" + metric.name + "\"");
+    size_t colon = json.find(':', key);
+    values.push_back(key == std::string::npos || colon == std::string::npos
+                         ? NAN
+                         : strtod(json.c_str() + colon + 1, nullptr));
+  }
+  return values;
+}
+
+std::string FormatNumber(double value) {
+  char text[64];
+  snprintf(text, sizeof(text), "%.6g", value);
+  return text;
+}
+
+/**
+ * Formats the results, and their comparison with the baseline if there is
+ * one.
+ *
+ * @param regressions output, number of metrics worse than the baseline by
+ *        more than the tolerance
+ */
+std::string FormatJson(const BenchConfig &config,
+                       const std::vector<Metric> &metrics,
+                       const std::vector<double> &baseline,
+                       size_t &regressions) {
+  std::ostringstream json;
+  json << "{\n  \"config\": {\n"
+       << "    \"images\": " << config.number_of_images << ",\n"
+       << "    \"image_size\": " << config.image_size << ",\n"
+       << "    \"classes\": " << config.number_of_classes << ",\n"
+       << "    \"threads\": " << config.number_of_threads << ",\n"
+       << "    \"repetitions\": " << config.repetitions << ",\n"
+       << "    \"seed\": " << config.seed << "\n  },\n"
+       << "  \"metrics\": {\n";
+  for (size_t i = 0; i < metrics.size(); i++) {
+    json << "    \"" << metrics[i].name << "\": " << FormatNumber(metrics[i].value)
+         << (i + 1 < metrics.size() ? ",\n" : "\n");
+  }
+  json << "  }";
+
+  regressions = 0;
+  if (!baseline.empty()) {
+    json << ",\n  \"baseline\": \"" << config.baseline_path << "\",\n"
+         << "  \"tolerance\": " << FormatNumber(config.tolerance) << ",\n"
+         << "  \"comparison\": {\n";
+    for (size_t i = 0; i < metrics.size(); i++) {
+      double change = NAN;
+      bool regressed = false;
+      if (!std::isnan(baseline[i]) && baseline[i] != 0.0) {
+        change = (metrics[i].value - baseline[i]) / baseline[i];
+        double improvement = metrics[i].higher_is_better ? change : -change;
+        regressed = improvement < -config.tolerance;
+      }
+      regressions += regressed;
+      json << "    \"" << metrics[i].name << "\": {\"baseline\": "
+           << (std::isnan(baseline[i]) ? "null" : FormatNumber(baseline[i]))
+           << ", \"change\": "
+           << (std::isnan(change) ? "null" : FormatNumber(change))
+           << ", \"regression\": " << (regressed ? "true" : "false") << "}"
+           << (i + 1 < metrics.size() ? ",\n" : "\n");
+    }
+    json << "  },\n  \"regressions\": " << regressions;
+  }
+  json << "\n}\n";
+  return json.str();
+}
+
+void PrintUsage() {
+  std::cerr
+      << "usage: naive-bayes-bench [options]\n"
+         "  --images N        images in the synthetic data set (20000)\n"
+         "  --image-size N    width and height of every image (28)\n"
+         "  --classes N       number of classes (10)\n"
+         "  --threads N       threads for the parallel stages (all cores)\n"
+         "  --repetitions N   runs per measurement, the median is kept (5)\n"
+         "  --seed N          seed of the synthetic data set (42)\n"
+         "  --work-dir PATH   where temporary files go (.)\n"
+         "  --output PATH     write the JSON there instead of stdout\n"
+         "  --baseline PATH   compare with the JSON of an earlier run\n"
+         "  --tolerance X     relative change counted as a regression (0.10)\n";
+}
+
+/**
+ * Parses the command line.
+ *
+ * @return false if the arguments are invalid or help was asked for
+ */
+bool ParseArguments(int argc, char **argv, BenchConfig &config) {
+  for (int i = 1; i < argc; i++) {
+    std::string option = argv[i];
+    if (option == "--help" || i + 1 >= argc) {
+      return false;
+    }
+    std::string value = argv[++i];
+    if (option == "--images") {
+      config.number_of_images = std::stoul(value);
+    } else if (option == "--image-size") {
+      config.image_size = std::stoul(value);
+    } else if (option == "--classes") {
+      config.number_of_classes = std::stoul(value);
+    } else if (option == "--threads") {
+      config.number_of_threads = std::stoul(value);
+    } else if (option == "--repetitions") {
+      config.repetitions = std::stoul(value);
+    } else if (option == "--seed") {
+      config.seed = (unsigned)std::stoul(value);
+    } else if (option == "--work-dir") {
+      config.work_directory = value;
+    } else if (option == "--output") {
+      config.output_path = value;
+    } else if (option == "--baseline") {
+      config.baseline_path = value;
+    } else if (option == "--tolerance") {
+      config.tolerance = std::stod(value);
+    } else {
+      return false;
+    }
+  }
+  return config.number_of_images > 0 && config.image_size > 0 &&
+         config.number_of_classes > 0 && config.number_of_threads > 0;
+}
+
+}
+
+int main(int argc, char **argv) {
+  BenchConfig config;
+  try {
+    if (!ParseArguments(argc, argv, config)) {
+      PrintUsage();
+      return 2;
+    }
+
+    std::vector<Metric> metrics = RunBenchmarks(config);
+    std::vector<double> baseline;
+    if (!config.baseline_path.empty()) {
+      baseline = ReadBaseline(config.baseline_path, metrics);
+    }
+
+    size_t regressions = 0;
+    std::string json = FormatJson(config, metrics, baseline, regressions);
+    if (config.output_path.empty()) {
+      std::cout << json;
+    } else {
+      std::ofstream output(config.output_path);
+      output << json;
+    }
+    if (regressions > 0) {
+      std::cerr << regressions << " metric(s) regressed beyond "
+                << config.tolerance * 100 << "%\n";
+      return 1;
+    }
+  } catch (const std::exception &error) {
+    std::cerr << "naive-bayes-bench: " << error.what() << "\n";
+    return 2;
+  }
+  return 0;
+}
@@ -0,0 +1,396 @@
+#include <core/bounded_queue.h>
+#include <core/class_index.h>
+#include <core/classifier.h>
+#include <core/model_file.h>
+#include <core/record_reader.h>
+#include <core/thread_pool.h>
+#include <core/training_model.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Evaluates a saved model on a labelled test set in the data set format and
+// reports accuracy, the confusion matrix, throughput and latency. Run with
+// --help for the options.
+
+namespace {
+
+struct EvaluationConfig {
+  std::string model_path;
+  std::string test_path;
+  size_t image_size = 28;
+  size_t number_of_threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t batch_size = 16384;
+  bool json = false;
+  bool branch_and_bound = false;
+};
+
+/**
+ * Images read from the test set, packed back to back.
+ */
+struct TestBatch {
+  std::vector<uint64_t> words;
+  std::vector<size_t> labels;
+};
+
+// images handed to a task at a time, and latency histogram buckets
+const size_t kImagesPerTask = 256;
+const double kBucketNanoseconds = 10.0;
+const size_t kNumberOfBuckets = 100000;
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * Accumulates the results of every batch.
+ */
+class Evaluation {
+
+public:
+  explicit Evaluation(const std::vector<size_t> &model_labels)
+      : classes_(model_labels), histogram_(kNumberOfBuckets, 0) {
+    matrix_.assign(classes_.size(), std::vector<uint64_t>(classes_.size(), 0));
+  }
+
+  /**
+   * Adds one classified image.
+   *
+   * @param label true label
+   * @param prediction predicted label
+   * @param nanoseconds time the classification took
+   */
+  void Add(size_t label, int prediction, double nanoseconds) {
+    size_t actual = classes_.Insert(label);
+    if (matrix_.size() < classes_.size()) {
+      for (std::vector<uint64_t> &row : matrix_) {
+        row.resize(classes_.size(), 0);
+      }
+      matrix_.resize(classes_.size(),
+                     std::vector<uint64_t>(classes_.size(), 0));
+    }
+    matrix_[actual][classes_.Find((size_t)prediction)]++;
+    correct_ += label == (size_t)prediction;
+    images_++;
+
+    size_t bucket = std::min<size_t>((size_t)(nanoseconds / kBucketNanoseconds),
+                                     kNumberOfBuckets - 1);
+    histogram_[bucket]++;
+    max_nanoseconds_ = std::max(max_nanoseconds_, nanoseconds);
+  }
+
+  /**
+   * Latency below which the given fraction of the images were classified.
+   *
+   * @param fraction between 0 and 1
+   * @return latency in microseconds, to the histogram resolution
+   */
+  double LatencyPercentile(double fraction) const {
+    uint64_t rank = (uint64_t)(fraction * images_);
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < kNumberOfBuckets; bucket++) {
+      seen += histogram_[bucket];
+      if (seen > rank) {
+        return bucket == kNumberOfBuckets - 1
+                   ? max_nanoseconds_ / 1e3
+                   : (bucket + 1) * kBucketNanoseconds / 1e3;
+      }
+    }
+    return max_nanoseconds_ / 1e3;
+  }
+
+  // Getters
+  uint64_t GetImages() const { return images_; }
+  uint64_t GetCorrect() const { return correct_; }
+  double GetMaxMicroseconds() const { return max_nanoseconds_ / 1e3; }
+  const naivebayes::ClassIndex &GetClasses() const { return classes_; }
+  const std::vector<std::vector<uint64_t>> &GetMatrix() const {
+    return matrix_;
+  }
+
+private:
+  // the model's classes, then any label only the test set has
+  naivebayes::ClassIndex classes_;
+
+  // [true class][predicted class]
+  std::vector<std::vector<uint64_t>> matrix_;
+
+  std::vector<uint64_t> histogram_;
+  double max_nanoseconds_ = 0.0;
+  uint64_t images_ = 0;
+  uint64_t correct_ = 0;
+};
+
+naivebayes::Classifier LoadClassifier(const EvaluationConfig &config) {
+  if (naivebayes::ModelFile::IsModelFile(config.model_path)) {
+    return naivebayes::Classifier(config.model_path);
+  }
+  naivebayes::TrainingModel model(config.image_size);
+  model.LoadTextModel(config.model_path);
+  return naivebayes::Classifier(model);
+}
+
+/**
+ * Reads the test set into batches, on its own thread so that reading
+ * overlaps classifying.
+ */
+void ReadBatches(std::istream &is, const EvaluationConfig &config,
+                 size_t image_size,
+                 naivebayes::BoundedQueue<std::unique_ptr<TestBatch>> &batches) {
+  naivebayes::RecordReader reader(is, image_size);
+  size_t words_per_image =
+      image_size * naivebayes::Image::WordsPerRow(image_size);
+  std::unique_ptr<TestBatch> batch(new TestBatch());
+  while (reader.Next()) {
+    const uint64_t *words = reader.GetImage().GetWords();
+    batch->words.insert(batch->words.end(), words, words + words_per_image);
+    batch->labels.push_back(reader.GetLabel());
+    if (batch->labels.size() == config.batch_size) {
+      if (!batches.Push(std::move(batch))) {
+        return;
+      }
+      batch.reset(new TestBatch());
+    }
+  }
+  if (!batch->labels.empty()) {
+    batches.Push(std::move(batch));
+  }
+}
+
+/**
+ * Streams the test set through the classifier.
+ *
+ * @return the results, and the wall time in seconds
+ */
+Evaluation Evaluate(const EvaluationConfig &config,
+                    const naivebayes::Classifier &classifier, double &seconds) {
+  std::ifstream file(config.test_path, std::ios::binary);
+  if (!file.is_open()) {
+    throw std::invalid_argument("could not open test set: " + config.test_path);
+  }
+
+  size_t image_size = classifier.GetImageSize();
+  size_t words_per_image =
+      image_size * naivebayes::Image::WordsPerRow(image_size);
+  Evaluation evaluation(classifier.GetLabels());
+  naivebayes::ThreadPool pool(config.number_of_threads);
+  naivebayes::BoundedQueue<std::unique_ptr<TestBatch>> batches(2);
+
+  Clock::time_point start = Clock::now();
+  std::exception_ptr read_error;
+  std::thread reader([&] {
+    try {
+      ReadBatches(file, config, image_size, batches);
+    } catch (...) {
+      read_error = std::current_exception();
+    }
+    batches.Close();
+  });
+
+  std::vector<int> predictions;
+  std::vector<float> latencies;
+  std::unique_ptr<TestBatch> batch;
+  try {
+    while (batches.Pop(batch)) {
+      size_t count = batch->labels.size();
+      predictions.resize(count);
+      latencies.resize(count);
+      pool.ParallelFor((count + kImagesPerTask - 1) / kImagesPerTask,
+                       [&](size_t task) {
+        size_t end = std::min(count, (task + 1) * kImagesPerTask);
+        for (size_t i = task * kImagesPerTask; i < end; i++) {
+          naivebayes::Image image(batch->labels[i], image_size,
+                                  &batch->words[i * words_per_image]);
+          Clock::time_point image_start = Clock::now();
+          predictions[i] = config.branch_and_bound
+                               ? classifier.ClassifyBranchAndBound(image)
+                               : classifier.Classify(image);
+          latencies[i] = std::chrono::duration<float, std::nano>(
+                             Clock::now() - image_start).count();
+        }
+      });
+      for (size_t i = 0; i < count; i++) {
+        evaluation.Add(batch->labels[i], predictions[i], latencies[i]);
+      }
+    }
+  } catch (...) {
+    batches.Close();
+    reader.join();
+    throw;
+  }
+  reader.join();
+  if (read_error) {
+    std::rethrow_exception(read_error);
+  }
+  seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  return evaluation;
+}
+
+std::string FormatNumber(double value) {
+  char text[64];
+  snprintf(text, sizeof(text), "%.6g", value);
+  return text;
+}
+
+std::string FormatJson(const EvaluationConfig &config,
+                       const Evaluation &evaluation, double seconds) {
+  const std::vector<size_t> &labels = evaluation.GetClasses().GetLabels();
+  const std::vector<std::vector<uint64_t>> &matrix = evaluation.GetMatrix();
+  double images = (double)evaluation.GetImages();
+
+  std::ostringstream json;
+  json << "{\n  \"model\": \"" << config.model_path << "\",\n"
+       << "  \"test_set\": \"" << config.test_path << "\",\n"
+       << "  \"threads\": " << config.number_of_threads << ",\n"
+       << "  \"images\": " << evaluation.GetImages() << ",\n"
+       << "  \"correct\": " << evaluation.GetCorrect() << ",\n"
+       << "  \"accuracy\": "
+       << FormatNumber(images > 0 ? evaluation.GetCorrect() / images : 0.0)
+       << ",\n"
+       << "  \"seconds\": " << FormatNumber(seconds) << ",\n"
+       << "  \"images_per_s\": "
+       << FormatNumber(seconds > 0 ? images / seconds : 0.0) << ",\n"
+       << "  \"latency_us\": {\"p50\": "
+       << FormatNumber(evaluation.LatencyPercentile(0.5)) << ", \"p90\": "
+       << FormatNumber(evaluation.LatencyPercentile(0.9)) << ", \"p99\": "
+       << FormatNumber(evaluation.LatencyPercentile(0.99)) << ", \"max\": "
+       << FormatNumber(evaluation.GetMaxMicroseconds()) << "},\n"
+       << "  \"labels\": [";
+  for (size_t i = 0; i < labels.size(); i++) {
+    json << (i > 0 ? ", " : "") << labels[i];
+  }
+  json << "],\n  \"confusion_matrix\": [\n";
+  for (size_t i = 0; i < matrix.size(); i++) {
+    json << "    [";
+    for (size_t j = 0; j < matrix[i].size(); j++) {
+      json << (j > 0 ? ", " : "") << matrix[i][j];
+    }
+    json << "]" << (i + 1 < matrix.size() ? ",\n" : "\n");
+  }
+  json << "  ]\n}\n";
+  return json.str();
+}
+
+std::string FormatText(const Evaluation &evaluation, double seconds) {
+  const std::vector<size_t> &labels = evaluation.GetClasses().GetLabels();
+  const std::vector<std::vector<uint64_t>> &matrix = evaluation.GetMatrix();
+  double images = (double)evaluation.GetImages();
+
+  std::ostringstream text;
+  text << "images:     " << evaluation.GetImages() << "\n"
+       << "accuracy:   "
+       << FormatNumber(images > 0 ? evaluation.GetCorrect() / images : 0.0)
+       << "\n"
+       << "images/s:   " << FormatNumber(seconds > 0 ? images / seconds : 0.0)
+       << "\n"
+       << "latency us: p50 " << FormatNumber(evaluation.LatencyPercentile(0.5))
+       << ", p90 " << FormatNumber(evaluation.LatencyPercentile(0.9))
+       << ", p99 " << FormatNumber(evaluation.LatencyPercentile(0.99))
+       << ", max " << FormatNumber(evaluation.GetMaxMicroseconds()) << "\n\n"
+       << "confusion matrix (rows true, columns predicted, then recall):\n";
+
+  char cell[32];
+  text << "      ";
+  for (const size_t &label : labels) {
+    snprintf(cell, sizeof(cell), "%8zu", label);
+    text << cell;
+  }
+  text << "\n";
+  for (size_t i = 0; i < matrix.size(); i++) {
+    uint64_t row_total = 0;
+    snprintf(cell, sizeof(cell), "%6zu", labels[i]);
+    text << cell;
+    for (const uint64_t &count : matrix[i]) {
+      snprintf(cell, sizeof(cell), "%8llu", (unsigned long long)count);
+      text << cell;
+      row_total += count;
+    }
+    snprintf(cell, sizeof(cell), "%9.4f",
+             row_total > 0 ? (double)matrix[i][i] / row_total : 0.0);
+    text << cell << "\n";
+  }
+  return text.str();
+}
+
+void PrintUsage() {
+  std::cerr
+      << "usage: evaluate-model [options] MODEL TEST_SET\n"
+         "  MODEL             binary (.nbm) or text model file\n"
+         "  TEST_SET          labelled images in the data set format\n"
+         "  --threads N       threads classifying (all cores)\n"
+         "  --batch-size N    images read ahead at a time (16384)\n"
+         "  --image-size N    image size of a text model (28)\n"
+         "  --json            print the results as JSON\n"
+         "  --branch-and-bound\n"
+         "                    skip the classes that cannot win (same labels)\n";
+}
+
+/**
+ * Parses the command line.
+ *
+ * @return false if the arguments are invalid or help was asked for
+ */
+bool ParseArguments(int argc, char **argv, EvaluationConfig &config) {
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++) {
+    std::string option = argv[i];
+    if (option == "--help") {
+      return false;
+    } else if (option == "--json") {
+      config.json = true;
+    } else if (option == "--branch-and-bound") {
+      config.branch_and_bound = true;
+    } else if (option.compare(0, 2, "--") != 0) {
+      paths.push_back(option);
+    } else if (i + 1 >= argc) {
+      return false;
+    } else if (option == "--threads") {
+      config.number_of_threads = std::stoul(argv[++i]);
+    } else if (option == "--batch-size") {
+      config.batch_size = std::stoul(argv[++i]);
+    } else if (option == "--image-size") {
+      config.image_size = std::stoul(argv[++i]);
+    } else {
+      return false;
+    }
+  }
+  if (paths.size() != 2) {
+    return false;
+  }
+  config.model_path = paths[0];
+  config.test_path = paths[1];
+  return config.number_of_threads > 0 && config.batch_size > 0 &&
+         config.image_size > 0;
+}
+
+}
+
+int main(int argc, char **argv) {
+  EvaluationConfig config;
+  try {
+    if (!ParseArguments(argc, argv, config)) {
+      PrintUsage();
+      return 2;
+    }
+
+    naivebayes::Classifier classifier = LoadClassifier(config);
+    if (classifier.GetLabels().empty()) {
+      throw std::invalid_argument("model has no classes");
+    }
+
+    double seconds = 0.0;
+    Evaluation evaluation = Evaluate(config, classifier, seconds);
+    std::cout << (config.json ? FormatJson(config, evaluation, seconds)
+                              : FormatText(evaluation, seconds));
+  } catch (const std::exception &error) {
+    std::cerr << "evaluate-model: " << error.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -1,20 +1,27 @@
 #include <core/data.h>
+#include <core/trace.h>
 #include <core/training_model.h>
-#include <core/image.h>
+#include <algorithm>
+#include <thread>
 
 // TODO: You may want to change main's signature to take in argc and argv
 //
 int main() {
-  // Create trainer and data
-  // >> (load)
-  naivebayes::Data data(28);
-  std::ifstream input_file("../data/trainingimagesandlabels.txt");
-  input_file>>data;
-  naivebayes::TrainingModel trainer(data);
+  // Create trainer and stream the data set through it, reading, parsing and
+  // counting at the same time
+  naivebayes::TrainingModel trainer(28);
+  trainer.TrainFile("../data/trainingimagesandlabels.txt",
+                    std::max(2u, std::thread::hardware_concurrency()));
 
   // << (save)
-  std::ofstream save_file;
-  save_file.open("../data/outstream_file.txt");
-  save_file<<trainer;
+  trainer.SaveTextModel("../data/outstream_file.txt");
 
+  // binary model file, mapped instead of parsed when loaded
+  trainer.SaveModelFile("../data/model.nbm");
+
+  // where the time went, for chrome://tracing; only built with the
+  // NAIVEBAYES_TRACING option
+  if (naivebayes::Tracer::kEnabled) {
+    naivebayes::Tracer::Get().WriteChromeTrace("../data/train_model_trace.json");
+  }
 }
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace naivebayes {
+
+// Size of a cache line on the platforms we care about.
+const size_t kCacheLineSize = 64;
+
+/**
+ * Allocator that hands out memory aligned to a cache line, so that the
+ * flat model tables start on a line boundary and are not split across
+ * lines by the default allocator.
+ */
+template <typename T, size_t Alignment = kCacheLineSize>
+class AlignedAllocator {
+public:
+  typedef T value_type;
+
+  template <typename U> struct rebind {
+    typedef AlignedAllocator<U, Alignment> other;
+  };
+
+  AlignedAllocator() {}
+
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+  T *allocate(size_t n) {
+    if (n == 0) {
+      return nullptr;
+    }
+    void *ptr = nullptr;
+#ifdef _WIN32
+    ptr = _aligned_malloc(n * sizeof(T), Alignment);
+#else
+    if (posix_memalign(&ptr, Alignment, n * sizeof(T)) != 0) {
+      ptr = nullptr;
+    }
+#endif
+    if (ptr == nullptr) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T *>(ptr);
+  }
+
+  void deallocate(T *ptr, size_t) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+  }
+};
+
+template <typename T, typename U, size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment> &,
+                const AlignedAllocator<U, Alignment> &) {
+  return true;
+}
+
+template <typename T, typename U, size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment> &,
+                const AlignedAllocator<U, Alignment> &) {
+  return false;
+}
+
+}
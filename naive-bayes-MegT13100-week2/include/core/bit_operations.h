@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace naivebayes {
+
+/**
+ * Index of the lowest set bit of a non-zero word.
+ *
+ * @param word non-zero word
+ * @return number of trailing zero bits
+ */
+inline unsigned CountTrailingZeros(uint64_t word) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, word);
+  return (unsigned)index;
+#else
+  return (unsigned)__builtin_ctzll(word);
+#endif
+}
+
+/**
+ * Number of set bits in a word.
+ *
+ * @param word word to count
+ * @return number of set bits
+ */
+inline unsigned PopCount(uint64_t word) {
+#ifdef _MSC_VER
+  return (unsigned)__popcnt64(word);
+#else
+  return (unsigned)__builtin_popcountll(word);
+#endif
+}
+
+/**
+ * Transposes a 64x64 bit matrix in place: afterwards bit c of matrix[r] is
+ * what bit r of matrix[c] was.
+ *
+ * @param matrix 64 rows of 64 bits
+ */
+inline void TransposeBitMatrix64(uint64_t matrix[64]) {
+  uint64_t mask = 0x00000000FFFFFFFFULL;
+  for (unsigned j = 32; j != 0; j >>= 1, mask ^= mask << j) {
+    for (unsigned k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+      uint64_t swap = ((matrix[k] >> j) ^ matrix[k | j]) & mask;
+      matrix[k] ^= swap << j;
+      matrix[k | j] ^= swap;
+    }
+  }
+}
+
+}
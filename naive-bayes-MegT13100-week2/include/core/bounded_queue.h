@@ -0,0 +1,80 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+namespace naivebayes {
+
+/**
+ * Blocking queue with a fixed capacity, used between the stages of a
+ * pipeline. A full queue makes its producer wait, so a slow stage holds back
+ * the stages before it instead of letting work pile up in memory.
+ */
+template <typename T>
+class BoundedQueue {
+
+public:
+  /**
+   * BoundedQueue constructor.
+   * @param capacity number of items the queue holds before Push() waits
+   */
+  explicit BoundedQueue(size_t capacity) : capacity_(capacity), closed_(false) {}
+
+  /**
+   * Adds an item, waiting while the queue is full.
+   *
+   * @param item item to move into the queue
+   * @return false, without adding the item, if the queue was closed
+   */
+  bool Push(T &&item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock,
+                   [this] { return closed_ || items_.size() < capacity_; });
+    if (closed_) {
+      return false;
+    }
+    items_.push_back(std::move(item));
+    not_empty_.notify_one();
+    return true;
+  }
+
+  /**
+   * Takes the oldest item, waiting while the queue is empty.
+   *
+   * @param item output, the item
+   * @return false once the queue is closed and empty
+   */
+  bool Pop(T &item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+    if (items_.empty()) {
+      return false;
+    }
+    item = std::move(items_.front());
+    items_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  /**
+   * Closes the queue: Push() fails from now on, and Pop() fails once the
+   * items already queued are taken. Wakes every waiting thread.
+   */
+  void Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+private:
+  size_t capacity_;
+  bool closed_;
+  std::deque<T> items_;
+  std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+};
+
+}
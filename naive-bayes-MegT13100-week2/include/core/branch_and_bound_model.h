@@ -0,0 +1,146 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "aligned_allocator.h"
+#include "image.h"
+#include "scoring_tables.h"
+
+namespace naivebayes {
+
+using std::vector;
+
+/**
+ * How much work a branch-and-bound classification did.
+ */
+struct BranchAndBoundStats {
+  // pixels scanned, shaded or not, before the classes were narrowed down
+  // to one
+  size_t pixels_scanned;
+  // classes still in the running after the scan, which were rescored
+  size_t classes_rescored;
+};
+
+/**
+ * Exact classification that stops scoring a class once it can no longer
+ * win. Pixels are scanned from the most to the least discriminative, the one
+ * whose weights differ the most between classes first, in rounds of
+ * kBoundInterval pixels. For the pixels left after each round, the model
+ * stores the sum of each class's positive weights and its largest weight,
+ * so that the shaded pixels left can add at most the smaller of that sum
+ * and their count times that weight, and likewise at least. After each
+ * round, a class is dropped when its partial score plus the most the
+ * remaining pixels can add falls below the final score of a class still in
+ * the running: the leader is scored to the end, class by class, whenever it
+ * changes. The scan stops once one class is left. Only the shaded pixels
+ * are scanned, with the same kernels as ScoringTables while most classes are
+ * left, and class by class once few are.
+ *
+ * The bounds leave a margin for the rounding of the float scores, and the
+ * classes left at the end of the scan are rescored in the same order as
+ * ScoringTables, so the label is always the one ScoringTables::Classify()
+ * returns.
+ */
+class BranchAndBoundModel {
+
+public:
+  // pixels scanned between two rounds of bounds, a divisor of the bits in
+  // a word of scan positions
+  static const size_t kBoundInterval = 64;
+
+  /**
+   * BranchAndBoundModel constructor that copies the tables in scan order
+   * and computes the bounds of every round.
+   * @param tables generic scoring tables
+   */
+  explicit BranchAndBoundModel(const ScoringTables &tables);
+
+  /**
+   * Classifies a packed image. Does not allocate for models of up to
+   * kMaxStackLanes classes and images of up to kMaxStackPixels pixels.
+   *
+   * @param image_words words of an image of the model's size
+   * @param stats output, the work done, if not null
+   * @return the most likely label, or -1 if the model has no classes
+   */
+  int Classify(const uint64_t *image_words,
+               BranchAndBoundStats *stats = nullptr) const;
+
+  // Getters
+  size_t GetImageSize() const;
+
+  /**
+   * Row major pixel indices in the order they are scanned.
+   */
+  const vector<size_t> &GetPixelOrder() const;
+
+private:
+  static const size_t kMaxStackLanes = 256;
+  static const size_t kMaxStackPixels = 4096;
+
+  // classes are scored one by one once fewer than one in this many lanes
+  // are left
+  static const size_t kClassByClassRatio = 4;
+
+  size_t image_size_;
+  size_t number_of_pixels_;
+  size_t number_of_classes_;
+  size_t lane_count_;
+  size_t number_of_rounds_;
+  vector<int> labels_;
+  vector<float, AlignedAllocator<float>> biases_;
+
+  // scan order, and the scan position of every pixel
+  vector<size_t> pixel_order_;
+  vector<size_t> scan_positions_;
+
+  // [scan position][lane] weights, laid out like the scoring tables, and
+  // the same weights as [class][scan position] for scoring class by class
+  vector<float, AlignedAllocator<float>> ordered_weights_;
+  vector<float, AlignedAllocator<float>> class_weights_;
+
+  // [round][lane] bounds on the weights of the pixels from the round on:
+  // the sums of the positive and of the negative weights, and the largest
+  // and smallest weight, taken as 0 if there is none of that sign
+  vector<float, AlignedAllocator<float>> positive_sums_;
+  vector<float, AlignedAllocator<float>> negative_sums_;
+  vector<float, AlignedAllocator<float>> highest_weights_;
+  vector<float, AlignedAllocator<float>> lowest_weights_;
+
+  // most that rounding can move a score or a bound away from its exact
+  // value, on both sides of a comparison
+  float rounding_margin_;
+
+  /**
+   * Bits of the scan positions of a round, from its first position on.
+   *
+   * @param positions bits of the scan positions of the shaded pixels
+   * @param round the round
+   * @return the round's bits
+   */
+  uint64_t RoundBits(const uint64_t *positions, size_t round) const;
+
+  /**
+   * Adds up the weights of a class for the shaded pixels of the rounds
+   * from the given one on.
+   *
+   * @param positions bits of the scan positions of the shaded pixels
+   * @param first_round first round to add
+   * @param class_index dense index of the class
+   * @return the sum
+   */
+  float RemainingScore(const uint64_t *positions, size_t first_round,
+                       size_t class_index) const;
+
+  /**
+   * Computes the float score of a class the way ScoringTables does: the
+   * bias plus the weights of the shaded pixels, in ascending pixel order.
+   *
+   * @param image_words words of an image of the model's size
+   * @param class_index dense index of the class
+   * @return the score
+   */
+  float ExactScore(const uint64_t *image_words, size_t class_index) const;
+};
+
+}
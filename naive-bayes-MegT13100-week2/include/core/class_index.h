@@ -0,0 +1,102 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace naivebayes {
+
+using std::vector;
+
+/**
+ * Dense class table: maps each external label to an internal index 0..n-1,
+ * so that counts, priors and tables can be plain arrays indexed by class.
+ * Small labels, which is nearly every data set, are found with one array
+ * lookup; larger ones fall back to a hash table.
+ */
+class ClassIndex {
+
+public:
+  // returned by Find() for a label without a class
+  static const size_t kNoClass;
+
+  ClassIndex();
+
+  /**
+   * ClassIndex constructor.
+   * @param labels labels of the classes, in index order, without repeats
+   */
+  explicit ClassIndex(const vector<size_t> &labels);
+
+  /**
+   * Index of the class of a label.
+   *
+   * @param label the label
+   * @return its index, or kNoClass if it has none
+   */
+  size_t Find(size_t label) const {
+    if (label < direct_.size()) {
+      uint32_t index = direct_[label];
+      return index == kNoDirectClass ? kNoClass : index;
+    }
+    if (label < kDirectLabelLimit) {
+      return kNoClass;
+    }
+    std::unordered_map<size_t, size_t>::const_iterator it =
+        large_labels_.find(label);
+    return it == large_labels_.end() ? kNoClass : it->second;
+  }
+
+  /**
+   * Index of the class of a label.
+   *
+   * @param label the label
+   * @return its index
+   * @throws std::out_of_range if the label has no class
+   */
+  size_t At(size_t label) const;
+
+  /**
+   * Gives a label a class, unless it already has one.
+   *
+   * @param label the label
+   * @return index of its class, the next free one if it is new
+   */
+  size_t Insert(size_t label);
+
+  /**
+   * Determines whether a label has a class.
+   *
+   * @param label the label
+   * @return true if it does
+   */
+  bool Contains(size_t label) const;
+
+  /**
+   * Removes every class.
+   */
+  void Clear();
+
+  // Getters
+  size_t size() const;
+  bool empty() const;
+  size_t GetLabel(size_t index) const;
+  const vector<size_t> &GetLabels() const;
+
+private:
+  // labels below this are looked up in direct_
+  static const size_t kDirectLabelLimit = 1 << 16;
+  static const uint32_t kNoDirectClass = UINT32_MAX;
+
+  // labels_[index] is the label of the class at that index
+  vector<size_t> labels_;
+
+  // index of every small label, kNoDirectClass if it has no class; only as
+  // long as the largest small label needs
+  vector<uint32_t> direct_;
+
+  // index of every label of kDirectLabelLimit or more
+  std::unordered_map<size_t, size_t> large_labels_;
+};
+
+}
@@ -0,0 +1,182 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "aligned_allocator.h"
+#include "branch_and_bound_model.h"
+#include "fixed_size_model.h"
+#include "image.h"
+#include "model_file.h"
+#include "scoring_tables.h"
+#include "training_model.h"
+
+namespace naivebayes {
+
+/**
+ * Immutable, inference-only model. It holds the class table, the priors and
+ * the log tables scoring needs, and none of the counts, probabilities or
+ * training images of a TrainingModel. Loaded from a binary model file, the
+ * log tables are used in place in the memory mapping.
+ *
+ * Classify() of a single packed image goes through a FixedSizeModel over the
+ * same tables when the image size is 3, 5 or 28 and there are at most 16
+ * classes, with the same results.
+ *
+ * ClassifyBranchAndBound() returns the same labels as Classify(), pruning
+ * the classes that can no longer win; it pays off with hundreds of classes.
+ * Its tables are only built, once, by its first call.
+ *
+ * Every method is const, so one Classifier can be shared by any number of
+ * threads classifying at once. Classify() does not allocate for models of
+ * up to 256 classes.
+ */
+class Classifier {
+
+public:
+  /**
+   * Classifier constructor that copies the scoring tables of a trained
+   * model.
+   * @param model TrainingModel reference
+   */
+  explicit Classifier(const TrainingModel &model);
+
+  /**
+   * Classifier constructor that maps a binary model file.
+   * @param file_path path of a file saved with TrainingModel::SaveModelFile()
+   * @throws std::invalid_argument if the file is not a valid model file
+   */
+  explicit Classifier(const std::string &file_path);
+
+  Classifier(Classifier &&other) = default;
+  Classifier &operator=(Classifier &&other) = default;
+  Classifier(const Classifier &) = delete;
+  Classifier &operator=(const Classifier &) = delete;
+
+  /**
+   * Classifies an image.
+   *
+   * @param image Image view, with the same image size as the classifier
+   * @return the most likely label, or -1 if there are no classes
+   */
+  int Classify(const Image &image) const;
+  int Classify(const vector<vector<size_t>> &pixels) const;
+
+  /**
+   * Classifies an image given only the row major indices of its shaded
+   * pixels.
+   *
+   * @param shaded_pixels indices of the shaded pixels
+   * @return the most likely label, or -1 if there are no classes
+   * @throws std::invalid_argument if an index is outside the image
+   */
+  int ClassifyShadedPixels(const vector<size_t> &shaded_pixels) const;
+
+  /**
+   * Classifies an image with the BranchAndBoundModel, which stops scoring
+   * the classes that can no longer win. Returns the same label as
+   * Classify(), and is faster when there are many classes. The first call
+   * builds the model, which copies the weight table twice.
+   *
+   * @param image Image view, with the same image size as the classifier
+   * @param stats output, the work done, if not null
+   * @return the most likely label, or -1 if there are no classes
+   */
+  int ClassifyBranchAndBound(const Image &image,
+                             BranchAndBoundStats *stats = nullptr) const;
+
+  /**
+   * Classifies a contiguous buffer of packed images. See
+   * ScoringTables::ClassifyBatch().
+   *
+   * @param images packed images, one after the other
+   * @param count number of images
+   * @param predictions output, the most likely label of each image
+   */
+  void ClassifyBatch(const uint64_t *images, size_t count,
+                     int *predictions) const;
+
+  /**
+   * ClassifyBatch() with the caller's working memory, so that classifying
+   * batch after batch does not allocate.
+   *
+   * @param images packed images, one after the other
+   * @param count number of images
+   * @param predictions output, the most likely label of each image
+   * @param scratch working memory, used by one thread at a time
+   */
+  void ClassifyBatch(const uint64_t *images, size_t count, int *predictions,
+                     BatchScratch &scratch) const;
+
+  /**
+   * Posterior probability of every class for an image. See
+   * ScoringTables::ComputePosteriors().
+   *
+   * @param image Image view, with the same image size as the classifier
+   * @param posteriors output, one probability per class, by class index
+   */
+  void ComputePosteriors(const Image &image, double *posteriors) const;
+
+  /**
+   * The k most likely classes of an image. See
+   * ScoringTables::FindTopClasses().
+   *
+   * @param image Image view, with the same image size as the classifier
+   * @param k number of classes wanted
+   * @param top_classes output, k entries from most to least likely
+   * @return number of entries that hold a class
+   */
+  size_t FindTopClasses(const Image &image, size_t k,
+                        ClassProbability *top_classes) const;
+
+  /**
+   * Posteriors and top classes of a contiguous buffer of packed images,
+   * written into the caller's buffers without allocating.
+   *
+   * @param images packed images, one after the other
+   * @param count number of images
+   * @param posteriors output, count rows of one probability per class
+   */
+  void ComputePosteriorsBatch(const uint64_t *images, size_t count,
+                              double *posteriors) const;
+  void FindTopClassesBatch(const uint64_t *images, size_t count, size_t k,
+                           ClassProbability *top_classes) const;
+
+  // Getters
+  size_t GetImageSize() const;
+  const vector<size_t> &GetLabels() const;
+  const vector<double> &GetPriors() const;
+  const vector<double> &GetLogPriors() const;
+  ScoringTables GetScoringTables() const;
+
+private:
+  size_t image_size_;
+
+  // class table: labels_[index] is the label of the class at that index
+  vector<size_t> labels_;
+  vector<double> priors_;
+  vector<double> log_priors_;
+
+  // the scoring tables point either into file_ or into the owned copies
+  size_t lane_count_;
+  std::unique_ptr<const ModelFile> file_;
+  vector<float, AlignedAllocator<float>> owned_weights_;
+  vector<float, AlignedAllocator<float>> owned_biases_;
+  const float *interleaved_weights_;
+  const float *class_biases_;
+
+  // specialization for the image size, reading the scoring tables in
+  // place, or null
+  std::unique_ptr<const SpecializedModel> specialized_;
+
+  // scan-ordered tables and bounds for ClassifyBranchAndBound(), built by
+  // its first call; held by pointer so that the Classifier stays movable
+  struct LazyBranchAndBound {
+    std::once_flag built;
+    std::unique_ptr<const BranchAndBoundModel> model;
+  };
+  std::unique_ptr<LazyBranchAndBound> branch_and_bound_;
+};
+
+}
@@ -1,6 +1,9 @@
 #pragma once
+#include <cstdint>
 #include <vector>
+#include "class_index.h"
 #include "image.h"
+#include "image_list.h"
 
 // should have the first overload.
 
@@ -34,38 +37,149 @@ public:
    */
   void FileReader(std::string file_path, Data &data);
 
+  /**
+   * Memory-maps a data set file and parses it in place.
+   *
+   * @param file_path path to the file
+   * @param number_of_threads number of threads parsing the file
+   */
+  void LoadFile(const std::string &file_path, size_t number_of_threads = 1);
+
+  /**
+   * Parses records in the same format as >>, decoding pixels straight from
+   * the bytes into the packed image buffer.
+   *
+   * With more than one thread, the buffer is split into chunks that are
+   * parsed concurrently. The images, labels and errors come out exactly as
+   * with one thread.
+   *
+   * @param begin first byte of the records
+   * @param end one past the last byte of the records
+   * @param number_of_threads number of threads parsing the buffer
+   * @throws std::invalid_argument naming the line of a bad label or of a
+   *         record that is missing rows
+   */
+  void ParseBuffer(const char *begin, const char *end,
+                   size_t number_of_threads = 1);
+
+  /**
+   * Appends an image to the contiguous image buffer.
+   *
+   * @param label class number
+   * @param pixels pixel vector of image_size_ rows of image_size_ pixels
+   * @throws std::invalid_argument if it has another size
+   */
+  void AddImage(size_t label, const vector<vector<size_t>> &pixels);
+
   //Getters
-  const vector<Image> &GetImages() const;
+  ImageList GetImages() const;
   size_t GetImageSize() const;
   const vector<size_t> &GetLabels() const;
 
 
 private:
+  // read records with the same parsing rules
+  friend class RecordReader;
+  friend class TrainingPipeline;
+
   // class variables
   size_t image_size_;
+  size_t words_per_image_;
 
   // class vectors
-  vector<Image> images_;
-  vector<size_t> labels_;
+  // every image packed back to back, words_per_image_ words each
+  vector<uint64_t> image_words_;
+  vector<size_t> image_labels_;
+
+  // unique labels, in order of appearance
+  ClassIndex labels_;
 
   // char vector
   const vector<char> shaded_values {'#', '+'};
 
+  // shade of every possible character, built from shaded_values
+  uint8_t shade_table_[256];
+
+  // chunks handed to each thread when parsing in parallel, so that uneven
+  // chunks even out, and the smallest chunk worth a task
+  static const size_t kChunksPerThread = 8;
+  static const size_t kMinChunkBytes = 64 * 1024;
+
+  /**
+   * Parses whole records from a block of a larger file.
+   *
+   * @param begin first byte of the block, the start of a record
+   * @param end one past the last byte of the block
+   * @param first_line_number line number of begin in the file, for errors
+   * @throws std::invalid_argument like ParseBuffer(), leaving the images as
+   *         they were
+   */
+  void ParseBlock(const char *begin, const char *end,
+                  size_t first_line_number);
+
+  /**
+   * Parses a buffer on a thread pool. Every record has image_size_ + 1
+   * lines, so counting the line breaks of each chunk tells exactly which
+   * records start in it and where their images go. The chunks are then
+   * parsed straight into place and their labels joined in order.
+   *
+   * @param begin first byte of the records
+   * @param end one past the last byte of the records
+   * @param number_of_threads number of threads parsing the buffer
+   */
+  void ParseChunks(const char *begin, const char *end,
+                   size_t number_of_threads);
+
   /**
-   * Keeps track of the Unique labels present in the text file.
+   * Parses one record into an image.
+   *
+   * @param cursor first byte of the record
+   * @param end one past the last byte of the buffer
+   * @param line_number line number of the label, for errors
+   * @param label output, the label
+   * @param image_words zeroed words of the image
+   * @return first byte after the record
+   */
+  const char *ParseRecord(const char *cursor, const char *end,
+                          size_t line_number, size_t &label,
+                          uint64_t *image_words) const;
+
+  /**
+   * Keeps track of the Unique labels present in the text file, in constant
+   * time per label.
    *
    * @param label
    */
   void UpdateAmountOfLabels(size_t label);
 
   /**
-   * Sets the pixel vector which is passed into the Image constructor to
-   * create an image.
+   * Appends room for one more image to the image buffer.
+   *
+   * @param label class number
+   * @return the zeroed words of the new image
+   */
+  uint64_t *AppendImage(size_t label);
+
+  /**
+   * Packs one text row of an image into its words.
+   *
+   * @param row first character of the row
+   * @param row_end one past the last character of the row
+   * @param row_words words of the row
+   */
+  void PackRow(const char *row, const char *row_end,
+               uint64_t *row_words) const;
+
+  /**
+   * Parses a label line the way std::stoi would.
    *
-   * @param pixels String vector
-   * @return a Pixel vector
+   * @param line first character of the line
+   * @param line_end one past the last character of the line
+   * @param label output, the label
+   * @return true if the line starts with a label
    */
-  vector<vector<size_t>> SetPixelVectorForImage(vector<std::string>& pixels) const;
+  static bool ParseLabel(const char *line, const char *line_end,
+                         size_t &label);
 };
 
 }
@@ -0,0 +1,113 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "image.h"
+
+namespace naivebayes {
+
+/**
+ * How images are counted during training.
+ */
+enum CountingKernel {
+  // walks the set bits of one image at a time
+  kImageLoopCounting,
+  // counts blocks of 64 images with bit slicing and popcounts
+  kBitSlicedCounting
+};
+
+/**
+ * Integer sufficient statistics of a training set: the number of images of
+ * each class and, for every class and pixel, how many of those images have
+ * the pixel shaded. Classes are addressed by their dense class index.
+ */
+class FeatureCounts {
+
+public:
+  /**
+   * FeatureCounts constructor, with every count at zero.
+   * @param number_of_classes number of classes
+   * @param number_of_pixels number of pixels in an image
+   */
+  FeatureCounts(size_t number_of_classes, size_t number_of_pixels);
+
+  /**
+   * FeatureCounts constructor that copies saved counts.
+   * @param number_of_classes number of classes
+   * @param number_of_pixels number of pixels in an image
+   * @param class_counts number_of_classes image counts
+   * @param shaded_counts [class][pixel] shaded counts
+   */
+  FeatureCounts(size_t number_of_classes, size_t number_of_pixels,
+                const uint32_t *class_counts, const uint32_t *shaded_counts);
+
+  /**
+   * Counts one image.
+   *
+   * @param class_index dense index of the image's class
+   * @param image Image view
+   */
+  void AddImage(size_t class_index, const Image &image);
+
+  /**
+   * Removes one previously counted image.
+   *
+   * @param class_index dense index of the image's class
+   * @param image Image view
+   */
+  void RemoveImage(size_t class_index, const Image &image);
+
+  /**
+   * Adds a class with zero counts after the last one.
+   */
+  void AppendClass();
+
+  /**
+   * Reorders the classes.
+   *
+   * @param order old index of the class at each new index, a permutation
+   */
+  void ReorderClasses(const vector<size_t> &order);
+
+  /**
+   * Counts a block of up to 64 consecutive packed images at once. The block
+   * is transposed so that each pixel becomes a 64-bit word with one bit per
+   * image, and the shaded count of a class is the popcount of that word
+   * masked to the images of the class.
+   *
+   * @param images packed images, one after the other
+   * @param image_size size of each image
+   * @param class_indices dense class index of every image
+   * @param count number of images, at most kBitSliceWidth
+   */
+  void AddImageBlock(const uint64_t *images, size_t image_size,
+                     const size_t *class_indices, size_t count);
+
+  static const size_t kBitSliceWidth = 64;
+
+  /**
+   * Adds the counts of another instance to this one.
+   *
+   * @param other counts with the same dimensions
+   */
+  void Merge(const FeatureCounts &other);
+
+  // Getters
+  uint32_t GetClassCount(size_t class_index) const;
+  uint64_t GetTotalCount() const;
+  uint32_t GetShadedCount(size_t class_index, size_t pixel) const;
+  size_t GetNumberOfClasses() const;
+  size_t GetNumberOfPixels() const;
+  const uint32_t *GetClassCounts() const;
+  const uint32_t *GetShadedCounts() const;
+
+private:
+  size_t number_of_pixels_;
+  uint64_t total_count_;
+
+  vector<uint32_t> class_counts_;
+  // laid out as [class][pixel]
+  vector<uint32_t> shaded_counts_;
+
+};
+
+}
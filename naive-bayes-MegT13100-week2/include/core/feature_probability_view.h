@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include "class_index.h"
+
+namespace naivebayes {
+
+/**
+ * Read-only view over the flat [class][pixel][shade] probability table of a
+ * TrainingModel. Indexed like the old nested container:
+ * view[row][column][shade][label]. The view must not outlive the model.
+ */
+class FeatureProbabilityView {
+
+public:
+  class ShadeView;
+  class PixelView;
+  class RowView;
+
+  /**
+   * FeatureProbabilityView constructor.
+   * @param table flat table laid out as [class][pixel][shade]
+   * @param class_index class index of the labels used in the table
+   * @param image_size size of the image
+   * @param number_of_shades number of shades per pixel
+   */
+  FeatureProbabilityView(const double *table, const ClassIndex &class_index,
+                         size_t image_size, size_t number_of_shades);
+
+  RowView operator[](size_t row) const;
+  size_t size() const;
+
+private:
+  const double *table_;
+  const ClassIndex *class_index_;
+  size_t image_size_;
+  size_t number_of_shades_;
+
+  /**
+   * Looks up a single probability in the flat table.
+   *
+   * @param label label of the class
+   * @param pixel row major pixel index
+   * @param shade shade of the pixel
+   * @return the probability
+   */
+  double Get(size_t label, size_t pixel, size_t shade) const;
+};
+
+/**
+ * Probabilities of one shade of one pixel, indexed by label.
+ */
+class FeatureProbabilityView::ShadeView {
+public:
+  ShadeView(const FeatureProbabilityView &view, size_t pixel, size_t shade);
+  double operator[](size_t label) const;
+  double at(size_t label) const;
+  size_t size() const;
+
+private:
+  FeatureProbabilityView view_;
+  size_t pixel_;
+  size_t shade_;
+};
+
+/**
+ * Probabilities of one pixel, indexed by shade.
+ */
+class FeatureProbabilityView::PixelView {
+public:
+  PixelView(const FeatureProbabilityView &view, size_t pixel);
+  ShadeView operator[](size_t shade) const;
+  size_t size() const;
+
+private:
+  FeatureProbabilityView view_;
+  size_t pixel_;
+};
+
+/**
+ * Probabilities of one row of pixels, indexed by column.
+ */
+class FeatureProbabilityView::RowView {
+public:
+  RowView(const FeatureProbabilityView &view, size_t row);
+  PixelView operator[](size_t column) const;
+  size_t size() const;
+
+private:
+  FeatureProbabilityView view_;
+  size_t row_;
+};
+
+}
@@ -1,3 +1,4 @@
+#pragma once
 #include <string>
 #include <vector>
 #include <core/training_model.h>
@@ -18,14 +19,22 @@ public:
   Data GetData();
 
   /**
-    * Handles reading the file.
+    * Handles reading the file. The file is mapped once: files of fewer
+    * than two lines are rejected as empty, and structural errors are
+    * reported, with their line number, while it is parsed.
+    *
+    * @throws std::invalid_argument if the path is empty, the file is
+    *         missing or has fewer than two lines, or a record is malformed
     */
   void HandleFile();
 
   /**
-    * Determines of the file is valid.
+    * Determines of the file is valid: it must have a label line and at
+    * least one more line. Records are only checked by HandleFile().
     * @param file_path path of the file
-    * @return true if the file is valid, false otherwise
+    * @return true if the file is valid
+    * @throws std::invalid_argument if the path is empty, or the file is
+    *         missing or has fewer than two lines
     */
   bool IsFileValid(std::string file_path);
 
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "image.h"
+#include "scoring_tables.h"
+
+namespace naivebayes {
+
+// most classes a specialized model holds, one float lane each
+const size_t kSpecializedLaneCount = 16;
+
+/**
+ * Single-image classification specialized for one image size, picked at run
+ * time by MakeFixedSizeModel().
+ */
+class SpecializedModel {
+
+public:
+  virtual ~SpecializedModel() = default;
+
+  /**
+   * Classifies a packed image.
+   *
+   * @param image_words words of an image of the model's size
+   * @return the most likely label
+   */
+  virtual int Classify(const uint64_t *image_words) const = 0;
+
+  // Getters
+  virtual size_t GetImageSize() const = 0;
+};
+
+/**
+ * Single-image classification with the image size and lane count fixed at
+ * compile time, so the word loop and the per-pixel lane update have
+ * constant bounds and are unrolled and vectorized. It reads the weights,
+ * biases and labels of the generic scoring tables in place, which must
+ * outlive it, and adds them up in the same order, so the labels are
+ * identical.
+ *
+ * Instantiated for images of size 3, 5 and 28, with 8 or 16 lanes.
+ */
+template <size_t kImageSize, size_t kLaneCount>
+class FixedSizeModel : public SpecializedModel {
+
+public:
+  static constexpr size_t kWordsPerRow =
+      (kImageSize + Image::kBitsPerWord - 1) / Image::kBitsPerWord;
+
+  /**
+   * FixedSizeModel constructor that points at generic scoring tables.
+   * @param tables tables of kImageSize images with kLaneCount lanes
+   * @throws std::invalid_argument if the tables do not fit
+   */
+  explicit FixedSizeModel(const ScoringTables &tables);
+
+  int Classify(const uint64_t *image_words) const override;
+  size_t GetImageSize() const override;
+
+private:
+  // [pixel][lane] weights, per-lane starting scores and the class table of
+  // the generic tables
+  const float *weights_;
+  const float *biases_;
+  const size_t *labels_;
+  size_t number_of_classes_;
+};
+
+extern template class FixedSizeModel<3, 8>;
+extern template class FixedSizeModel<3, 16>;
+extern template class FixedSizeModel<5, 8>;
+extern template class FixedSizeModel<5, 16>;
+extern template class FixedSizeModel<28, 8>;
+extern template class FixedSizeModel<28, 16>;
+
+/**
+ * Picks the specialization for the image size and lane count of a set of
+ * scoring tables.
+ *
+ * @param tables generic scoring tables, which must outlive the model
+ * @return the specialized model, or null if the image size has no
+ *         specialization or there are too many classes
+ */
+std::unique_ptr<const SpecializedModel> MakeFixedSizeModel(
+    const ScoringTables &tables);
+
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <core/pixel.h>
@@ -8,31 +9,88 @@ using naivebayes::Pixel;
 
 namespace naivebayes {
 
+/**
+ * Lightweight view of a bit-packed binary image. Each pixel is one bit and
+ * every row is padded to a whole number of 64-bit words. The words are owned
+ * by whoever created the view, usually a Data instance.
+ */
 class Image {
 
 public:
+  static const size_t kBitsPerWord = 64;
+
   /**
    * Image constructor.
    * @param label class number
    * @param image_size size of image
-   * @param image pixel vector
+   * @param words packed rows of the image
+   */
+  Image(size_t label, size_t image_size, const uint64_t *words);
+
+  /**
+   * Number of 64-bit words needed to store one row of an image.
+   *
+   * @param image_size size of the image
+   * @return words per row
+   */
+  static size_t WordsPerRow(size_t image_size);
+
+  /**
+   * Packs a pixel vector into rows of 64-bit words.
+   *
+   * @param pixels pixel vector
+   * @param image_size size of the image
+   * @param words output, at least image_size * WordsPerRow(image_size) words
+   */
+  static void Pack(const vector<vector<size_t>> &pixels, size_t image_size,
+                   uint64_t *words);
+
+  /**
+   * Collects the row major indices of the shaded pixels of a pixel vector.
+   *
+   * @param pixels pixel vector
+   * @param shaded_pixels output, cleared first
    */
-  Image(size_t label, size_t image_size, vector<vector<size_t>> &image);
+  static void FindShadedPixels(const vector<vector<size_t>> &pixels,
+                               vector<size_t> &shaded_pixels);
+
+  /**
+   * Collects the row major indices of the shaded pixels, in ascending order.
+   *
+   * @param shaded_pixels output, cleared first
+   */
+  void GetShadedPixels(vector<size_t> &shaded_pixels) const;
+
+  /**
+   * Shade of a single pixel.
+   *
+   * @param row row of the pixel
+   * @param column column of the pixel
+   * @return kShadedPixel or kUnshadedPixel
+   */
+  size_t GetPixel(size_t row, size_t column) const;
 
   // Getters
   const size_t &GetLabel() const;
   const size_t &GetImageSize() const;
-  const vector<vector<size_t>> &GetImage() const;
+  const uint64_t *GetWords() const;
+  size_t GetWordsPerRow() const;
+
+  /**
+   * Unpacks the image.
+   *
+   * @return pixel vector
+   */
+  vector<vector<size_t>> GetImage() const;
 
 private:
   // Private variables
   size_t label_;
   size_t image_size_;
-  vector<vector<size_t>> image_;
+  const uint64_t *words_;
 
 };
 
 
 }
 
-
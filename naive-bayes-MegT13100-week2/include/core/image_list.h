@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <iterator>
+#include "image.h"
+
+namespace naivebayes {
+
+/**
+ * Read-only range of Image views over a contiguous buffer of packed images,
+ * as stored by Data. The list must not outlive the buffer it points into.
+ */
+class ImageList {
+
+public:
+  /**
+   * Forward iterator that produces an Image view per position.
+   */
+  class const_iterator {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef Image value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const Image *pointer;
+    typedef Image reference;
+
+    const_iterator(const ImageList *list, size_t index);
+
+    Image operator*() const;
+    const_iterator &operator++();
+    const_iterator operator++(int);
+    bool operator==(const const_iterator &other) const;
+    bool operator!=(const const_iterator &other) const;
+
+  private:
+    const ImageList *list_;
+    size_t index_;
+  };
+
+  /**
+   * ImageList constructor.
+   * @param words packed images, one after the other
+   * @param labels label of every image
+   * @param count number of images
+   * @param image_size size of each image
+   */
+  ImageList(const uint64_t *words, const size_t *labels, size_t count,
+            size_t image_size);
+
+  Image operator[](size_t index) const;
+
+  /**
+   * Bounds checked access.
+   *
+   * @param index position of the image
+   * @return view of the image
+   */
+  Image at(size_t index) const;
+
+  size_t size() const;
+  bool empty() const;
+  const_iterator begin() const;
+  const_iterator end() const;
+
+private:
+  const uint64_t *words_;
+  const size_t *labels_;
+  size_t count_;
+  size_t image_size_;
+  size_t words_per_image_;
+};
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+namespace naivebayes {
+
+/**
+ * Read-only memory mapping of a whole file. The mapping is released when the
+ * MappedFile is destroyed, so pointers into it must not outlive it.
+ */
+class MappedFile {
+
+public:
+  /**
+   * Maps a file.
+   * @param file_path path of the file
+   * @throws std::invalid_argument if the file cannot be opened or mapped
+   */
+  explicit MappedFile(const std::string &file_path);
+
+  ~MappedFile();
+
+  MappedFile(MappedFile &&other);
+  MappedFile &operator=(MappedFile &&other);
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // Getters
+  const char *GetData() const;
+  size_t GetSize() const;
+  bool IsEmpty() const;
+
+private:
+  const char *data_;
+  size_t size_;
+
+#ifdef _WIN32
+  void *mapping_handle_;
+#endif
+
+  /**
+   * Unmaps the file, if it is mapped.
+   */
+  void Release();
+};
+
+}
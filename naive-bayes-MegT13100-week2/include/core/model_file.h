@@ -0,0 +1,156 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "mapped_file.h"
+
+namespace naivebayes {
+
+/**
+ * Fixed-size header at the start of a binary model file. All values are in
+ * the native byte order of the machine that wrote the file, so files are
+ * not portable across byte orders; opening a file written with the other
+ * byte order fails on its magic number. The sections follow at 64-byte aligned offsets that are
+ * derived from the dimensions in the header, in the order of
+ * ModelFile::Section.
+ */
+struct ModelFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t image_size;
+  uint32_t number_of_shades;
+  uint32_t number_of_classes;
+  uint32_t lane_count;
+  uint32_t flags;
+  uint32_t reserved;
+  uint64_t file_size;
+  // hash of every byte after the header
+  uint64_t checksum;
+};
+
+/**
+ * Pointers to the contents of a model, in the layout TrainingModel keeps
+ * them. The counts may be null for a model without counts.
+ */
+struct ModelFileSections {
+  size_t image_size;
+  size_t number_of_shades;
+  size_t number_of_classes;
+  size_t lane_count;
+
+  const uint64_t *labels;
+  const double *priors;
+  const double *log_priors;
+  const double *feature_probabilities;
+  const double *unshaded_baselines;
+  const double *shaded_deltas;
+  const float *interleaved_weights;
+  const float *class_biases;
+  const uint32_t *class_counts;
+  const uint32_t *shaded_counts;
+};
+
+/**
+ * Versioned binary model file, memory-mapped and read in place. Opening a
+ * file checks its magic number, version, size and checksum; the section
+ * getters then point straight into the mapping, which lives as long as the
+ * ModelFile.
+ */
+class ModelFile {
+
+public:
+  // "NBMF" read as a little-endian integer, and its bytes reversed as read
+  // from a file written with the other byte order
+  static const uint32_t kMagic = 0x464D424E;
+  static const uint32_t kSwappedMagic = 0x4E424D46;
+  static const uint32_t kVersion = 1;
+  static const uint32_t kHasCounts = 1;
+  static const size_t kSectionAlignment = 64;
+
+  enum Section {
+    kLabels,
+    kPriors,
+    kLogPriors,
+    kFeatureProbabilities,
+    kUnshadedBaselines,
+    kShadedDeltas,
+    kInterleavedWeights,
+    kClassBiases,
+    kClassCounts,
+    kShadedCounts,
+    kNumberOfSections
+  };
+
+  /**
+   * Maps and validates a model file.
+   * @param file_path path of the file
+   * @throws std::invalid_argument if the file is not a valid model file
+   */
+  explicit ModelFile(const std::string &file_path);
+
+  /**
+   * Writes a model file.
+   *
+   * @param file_path path of the file
+   * @param sections contents of the model
+   */
+  static void Write(const std::string &file_path,
+                    const ModelFileSections &sections);
+
+  /**
+   * Determines whether a file starts with the model file magic number.
+   *
+   * @param file_path path of the file
+   * @return true if the file looks like a binary model
+   */
+  static bool IsModelFile(const std::string &file_path);
+
+  // Getters
+  const ModelFileHeader &GetHeader() const;
+  bool HasCounts() const;
+
+  /**
+   * Contents of the mapped model. The pointers are valid as long as this
+   * ModelFile is.
+   *
+   * @return pointers into the mapping
+   */
+  ModelFileSections GetSections() const;
+
+private:
+  MappedFile file_;
+  size_t offsets_[kNumberOfSections + 1];
+
+  /**
+   * Computes the size of every section, without padding.
+   *
+   * @param header dimensions of the model
+   * @param sizes output
+   */
+  static void ComputeSectionSizes(const ModelFileHeader &header,
+                                  size_t *sizes);
+
+  /**
+   * Computes where every section starts; offsets[kNumberOfSections] is the
+   * size of the whole file.
+   *
+   * @param header dimensions of the model
+   * @param offsets output
+   */
+  static void ComputeOffsets(const ModelFileHeader &header, size_t *offsets);
+
+  /**
+   * Hashes a buffer 64 bits at a time.
+   *
+   * @param begin start of the buffer, 8-byte aligned
+   * @param size size of the buffer, a multiple of 8
+   * @return the hash
+   */
+  static uint64_t Checksum(const char *begin, size_t size);
+
+  /**
+   * Pointer to the start of a section of the mapping.
+   */
+  const char *SectionData(Section section) const;
+};
+
+}
@@ -0,0 +1,165 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "classifier.h"
+#include "image.h"
+
+namespace naivebayes {
+
+/**
+ * Holds the Classifier a long-running process serves, and replaces it
+ * without a restart. New models are published with an atomic pointer swap:
+ * classifications already running finish against the old model, every later
+ * one sees the new model, and the old model is freed once its last reader
+ * is done (read-copy-update).
+ *
+ * Reading takes no lock. A reader only marks itself in one of two reader
+ * counters, picked by the current epoch. Publishing swaps the pointer, then
+ * flips the epoch twice, each time waiting for the counter it flipped away
+ * from to drain, so it waits for every reader that could still see the old
+ * model and is never starved by new ones.
+ */
+class ModelHolder {
+
+public:
+  /**
+   * Read access to the model that was current when it was acquired. The
+   * model stays valid, even if a new one is published, until the snapshot
+   * is destroyed. A thread must not publish while it holds a snapshot.
+   */
+  class Snapshot {
+
+  public:
+    Snapshot(Snapshot &&other);
+    ~Snapshot();
+
+    Snapshot(const Snapshot &) = delete;
+    Snapshot &operator=(const Snapshot &) = delete;
+    Snapshot &operator=(Snapshot &&) = delete;
+
+    const Classifier &operator*() const;
+    const Classifier *operator->() const;
+
+  private:
+    friend class ModelHolder;
+
+    Snapshot(std::atomic<size_t> *readers, const Classifier *classifier);
+
+    // counter this reader is marked in, null once moved from
+    std::atomic<size_t> *readers_;
+    const Classifier *classifier_;
+  };
+
+  /**
+   * ModelHolder constructor.
+   * @param classifier the first model
+   */
+  explicit ModelHolder(std::unique_ptr<const Classifier> classifier);
+
+  /**
+   * ModelHolder constructor that loads the first model from a file.
+   * @param file_path binary or text model file
+   * @param image_size size of the images of a text model
+   * @throws std::invalid_argument if the file cannot be loaded
+   */
+  ModelHolder(const std::string &file_path, size_t image_size);
+
+  /**
+   * Waits for a background load, then frees the current model. No snapshot
+   * may outlive the holder.
+   */
+  ~ModelHolder();
+
+  ModelHolder(const ModelHolder &) = delete;
+  ModelHolder &operator=(const ModelHolder &) = delete;
+
+  /**
+   * Takes a snapshot of the current model, without locking.
+   *
+   * @return the snapshot
+   */
+  Snapshot Acquire() const;
+
+  /**
+   * Classifies an image with the current model.
+   *
+   * @param image Image view, with the same image size as the model
+   * @return the most likely label, or -1 if the model has no classes
+   */
+  int Classify(const Image &image) const;
+  int Classify(const vector<vector<size_t>> &pixels) const;
+
+  /**
+   * Makes a new model current, waits until no reader can still see the old
+   * one, and frees it. Publishers are serialized with each other, never
+   * with readers.
+   *
+   * @param classifier the new model
+   */
+  void Publish(std::unique_ptr<const Classifier> classifier);
+
+  /**
+   * Loads a model file on a background thread and publishes it once it is
+   * loaded. Waits for the previous background load first.
+   *
+   * @param file_path binary or text model file
+   */
+  void LoadAsync(const std::string &file_path);
+
+  /**
+   * Waits for the background load, if any.
+   *
+   * @throws the error that stopped the load, in which case the current
+   *         model was kept
+   */
+  void WaitForLoad();
+
+  /**
+   * Loads a classifier from a binary model file, or from a text model if
+   * the file is not a binary model file.
+   *
+   * @param file_path path of the file
+   * @param image_size size of the images of a text model
+   * @return the classifier
+   * @throws std::invalid_argument if the file cannot be loaded
+   */
+  static std::unique_ptr<const Classifier> LoadClassifier(
+      const std::string &file_path, size_t image_size);
+
+  // Getters
+  /**
+   * Number of models published so far, counting the first one.
+   */
+  size_t GetVersion() const;
+
+private:
+  std::atomic<const Classifier *> current_;
+  std::atomic<size_t> version_;
+
+  // readers_[epoch_ % 2] counts the readers that started in this epoch;
+  // each counter has its own cache line
+  struct alignas(64) ReaderCounter {
+    std::atomic<size_t> count;
+  };
+  mutable ReaderCounter readers_[2];
+  std::atomic<size_t> epoch_;
+
+  // serializes publishers, and guards the background load
+  std::mutex publish_mutex_;
+  std::mutex load_mutex_;
+  std::thread loader_;
+  std::exception_ptr load_error_;
+
+  /**
+   * Flips the epoch and waits for the readers of the previous one.
+   */
+  void WaitForReaders();
+};
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+#include "data.h"
+#include "image.h"
+
+namespace naivebayes {
+
+/**
+ * Reads the records of a data set one at a time, in the same label + N-lines
+ * format Data parses. Only the current record is kept, so memory does not
+ * grow with the number of records in the stream.
+ */
+class RecordReader {
+
+public:
+  /**
+   * RecordReader constructor.
+   * @param is input stream of records
+   * @param image_size size of the images
+   */
+  RecordReader(std::istream &is, size_t image_size);
+
+  /**
+   * Reads the next record, replacing the current one.
+   *
+   * @return false once the stream has no more records
+   * @throws std::invalid_argument naming the line of a bad label or of a
+   *         record that is missing rows
+   */
+  bool Next();
+
+  // Getters
+  size_t GetLabel() const;
+
+  /**
+   * View of the current image, valid until the next call to Next().
+   *
+   * @return Image view
+   */
+  Image GetImage() const;
+
+  size_t GetRecordCount() const;
+
+private:
+  std::istream &is_;
+
+  // parsing rules, shared with Data; holds no images
+  Data data_;
+
+  size_t label_;
+  vector<uint64_t> image_words_;
+  std::string line_;
+  size_t line_number_;
+  size_t record_count_;
+};
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+
+namespace naivebayes {
+
+/**
+ * Class-interleaved scoring kernels. A weight table holds one row per pixel
+ * and one float lane per class, with rows padded to a multiple of
+ * kScoringLaneWidth lanes. Accumulating the rows of the shaded pixels of an
+ * image scores every class at once.
+ *
+ * Every kernel adds the rows in the order given, lane by lane, so all of
+ * them produce bit-identical results.
+ */
+
+// Rows of a weight table are padded to a multiple of this many floats.
+const size_t kScoringLaneWidth = 8;
+
+enum ScoringKernel {
+  kScalarKernel,
+  kSse42Kernel,
+  kAvx2Kernel
+};
+
+/**
+ * Adds weights[rows[k] * stride + lane] to scores[lane] for every row k and
+ * every lane below stride.
+ *
+ * @param weights class-interleaved weight table
+ * @param stride number of lanes in a row, a multiple of kScoringLaneWidth
+ * @param rows rows to add
+ * @param row_count number of rows to add
+ * @param scores stride accumulators
+ */
+typedef void (*AccumulateRowsFunction)(const float *weights, size_t stride,
+                                       const size_t *rows, size_t row_count,
+                                       float *scores);
+
+/**
+ * Scalar reference implementation of AccumulateRowsFunction.
+ */
+void AccumulateRowsScalar(const float *weights, size_t stride,
+                          const size_t *rows, size_t row_count, float *scores);
+
+/**
+ * Runs the fastest kernel supported by this CPU.
+ */
+void AccumulateRows(const float *weights, size_t stride, const size_t *rows,
+                    size_t row_count, float *scores);
+
+/**
+ * Determines whether a kernel was compiled in and can run on this CPU.
+ *
+ * @param kernel kernel to check
+ * @return true if the kernel can be used
+ */
+bool IsScoringKernelSupported(ScoringKernel kernel);
+
+/**
+ * Picks the fastest supported kernel: AVX2, then SSE4.2, then scalar.
+ *
+ * @return the kernel AccumulateRows dispatches to
+ */
+ScoringKernel GetBestScoringKernel();
+
+/**
+ * Looks up the implementation of a kernel.
+ *
+ * @param kernel a supported kernel
+ * @return the kernel's function
+ */
+AccumulateRowsFunction GetScoringKernel(ScoringKernel kernel);
+
+/**
+ * Pads a number of classes up to a whole number of lanes.
+ *
+ * @param number_of_classes number of classes
+ * @return row stride of the weight table
+ */
+size_t PaddedLaneCount(size_t number_of_classes);
+
+}
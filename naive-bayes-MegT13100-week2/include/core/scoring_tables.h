@@ -0,0 +1,242 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace naivebayes {
+
+using std::vector;
+
+/**
+ * A label and its posterior probability.
+ */
+struct ClassProbability {
+  int label;
+  double probability;
+};
+
+/**
+ * Working memory of ScoringTables::ClassifyBatch(). A caller that keeps one
+ * across calls, one per thread, only allocates on its first batch with a
+ * model.
+ */
+struct BatchScratch {
+  // scores of a block of images, one row of lanes per image
+  vector<float> scores;
+};
+
+/**
+ * Read-only view over the tables a model is scored with: the class labels,
+ * the per-class starting scores and the [pixel][lane] shaded weights. Both
+ * TrainingModel and Classifier classify through it. The view must not
+ * outlive the tables.
+ *
+ * Every method is const and only reads the tables, so any number of threads
+ * may classify through views of the same tables at once, as long as nothing
+ * modifies them.
+ */
+class ScoringTables {
+
+public:
+  /**
+   * ScoringTables constructor.
+   * @param image_size size of the image
+   * @param labels label of every class, number_of_classes of them
+   * @param number_of_classes number of classes
+   * @param lane_count padded number of classes in the weight rows
+   * @param interleaved_weights [pixel][lane] weight of each shaded pixel
+   * @param class_biases starting score of each lane
+   */
+  ScoringTables(size_t image_size, const size_t *labels,
+                size_t number_of_classes, size_t lane_count,
+                const float *interleaved_weights, const float *class_biases);
+
+  /**
+   * Classifies a packed image. Does not allocate for models of up to
+   * kMaxStackLanes classes.
+   *
+   * @param image_words words of an image of the tables' size
+   * @return the most likely label, or -1 if there are no classes
+   */
+  int Classify(const uint64_t *image_words) const;
+
+  /**
+   * Classifies an image given as a pixel vector. Does not allocate for
+   * models of up to kMaxStackLanes classes.
+   *
+   * @param pixels pixel vector of the tables' size
+   * @return the most likely label, or -1 if there are no classes
+   * @throws std::invalid_argument if the image is not of the tables' size
+   */
+  int Classify(const vector<vector<size_t>> &pixels) const;
+
+  /**
+   * Classifies an image given only the row major indices of its shaded
+   * pixels. Every other pixel is taken to be unshaded.
+   *
+   * @param shaded_pixels indices of the shaded pixels
+   * @return the most likely label, or -1 if there are no classes
+   * @throws std::invalid_argument if an index is outside the image
+   */
+  int ClassifyShadedPixels(const vector<size_t> &shaded_pixels) const;
+
+  /**
+   * Classifies a contiguous buffer of packed images, laid out like Data
+   * stores them.
+   *
+   * Images are scored a block at a time, and each block walks the weight
+   * table in slices small enough to stay in cache while every image of the
+   * block is scored against them. The results match ClassifyShadedPixels().
+   * Allocates the block's scores; the overload that takes a BatchScratch
+   * reuses them.
+   *
+   * @param images packed images, one after the other
+   * @param count number of images
+   * @param predictions output, the most likely label of each image
+   */
+  void ClassifyBatch(const uint64_t *images, size_t count,
+                     int *predictions) const;
+
+  /**
+   * ClassifyBatch() with the caller's working memory, which does not
+   * allocate once the scratch has held the scores of a block.
+   *
+   * @param images packed images, one after the other
+   * @param count number of images
+   * @param predictions output, the most likely label of each image
+   * @param scratch working memory, used by one thread at a time
+   */
+  void ClassifyBatch(const uint64_t *images, size_t count, int *predictions,
+                     BatchScratch &scratch) const;
+
+  /**
+   * Computes the posterior probability of every class for a packed image.
+   * The class scores are normalized with log-sum-exp, subtracting the
+   * highest score before exponentiating, so no score underflows to zero.
+   * Does not allocate for models of up to kMaxStackLanes classes.
+   *
+   * @param image_words words of an image of the tables' size
+   * @param posteriors output, one probability per class, by class index
+   */
+  void ComputePosteriors(const uint64_t *image_words,
+                         double *posteriors) const;
+
+  /**
+   * Finds the k most likely classes of a packed image, with partial
+   * selection rather than a sort of every class. Ties go to the lower class
+   * index, so the first result is the label Classify() returns. Does not
+   * allocate for models of up to kMaxStackLanes classes.
+   *
+   * @param image_words words of an image of the tables' size
+   * @param k number of classes wanted
+   * @param top_classes output, k entries from most to least likely; entries
+   *        past the number of classes are set to label -1, probability 0
+   * @return number of entries that hold a class
+   */
+  size_t FindTopClasses(const uint64_t *image_words, size_t k,
+                        ClassProbability *top_classes) const;
+
+  /**
+   * ComputePosteriors() for a contiguous buffer of packed images.
+   *
+   * @param images packed images, one after the other
+   * @param count number of images
+   * @param posteriors output, count rows of one probability per class
+   */
+  void ComputePosteriorsBatch(const uint64_t *images, size_t count,
+                              double *posteriors) const;
+
+  /**
+   * FindTopClasses() for a contiguous buffer of packed images.
+   *
+   * @param images packed images, one after the other
+   * @param count number of images
+   * @param k number of classes wanted per image
+   * @param top_classes output, count rows of k entries
+   */
+  void FindTopClassesBatch(const uint64_t *images, size_t count, size_t k,
+                           ClassProbability *top_classes) const;
+
+  // Getters
+  size_t GetImageSize() const;
+  const size_t *GetLabels() const;
+  size_t GetNumberOfClasses() const;
+  size_t GetLaneCount() const;
+  const float *GetInterleavedWeights() const;
+  const float *GetClassBiases() const;
+
+private:
+  size_t image_size_;
+  const size_t *labels_;
+  size_t number_of_classes_;
+  size_t lane_count_;
+  const float *interleaved_weights_;
+  const float *class_biases_;
+
+  // Constant variables
+  static const size_t kBatchBlockSize = 64;
+  static const size_t kWeightBlockBytes = 32 * 1024;
+
+  // lanes whose scores fit on the stack, and shaded pixels gathered before
+  // their rows are added
+  static const size_t kMaxStackLanes = 256;
+  static const size_t kRowBatchSize = 64;
+
+  /**
+   * Checks that a pixel vector has the tables' size, so that every row
+   * major index into it is in the tables.
+   *
+   * @param pixels pixel vector
+   * @throws std::invalid_argument if it does not
+   */
+  void CheckImageSize(const vector<vector<size_t>> &pixels) const;
+
+  /**
+   * Points the scores at a stack buffer, or at a heap buffer if there are
+   * too many lanes for it, and sets them to the class biases.
+   *
+   * @param stack_scores kMaxStackLanes floats
+   * @param heap_scores empty vector, resized only for more lanes than that
+   * @return the scores
+   */
+  float *StartScores(float *stack_scores, vector<float> &heap_scores) const;
+
+  /**
+   * Adds the rows of the shaded pixels of a packed image to the scores,
+   * one word of pixels at a time, in ascending pixel order.
+   *
+   * @param image_words words of an image of the tables' size
+   * @param scores lane_count_ scores
+   */
+  void ScoreImage(const uint64_t *image_words, float *scores) const;
+
+  /**
+   * Adds the rows of the shaded pixels of a packed image that fall in a
+   * range of row major pixel indices to the scores, in ascending order.
+   *
+   * @param image_words words of an image of the tables' size
+   * @param first_pixel first pixel of the range
+   * @param end_pixel one past the last pixel of the range
+   * @param scores lane_count_ scores
+   */
+  void ScorePixelRange(const uint64_t *image_words, size_t first_pixel,
+                       size_t end_pixel, float *scores) const;
+
+  /**
+   * Log of the sum of the exponentials of the class scores.
+   *
+   * @param scores score of every lane
+   * @return the log normalizer
+   */
+  double LogSumExp(const float *scores) const;
+
+  /**
+   * Label of the class with the highest score.
+   *
+   * @param scores score of every lane
+   * @return the label, or -1 if there are no classes
+   */
+  int MostLikely(const float *scores) const;
+};
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace naivebayes {
+
+/**
+ * Fixed set of worker threads that run the tasks of one ParallelFor() at a
+ * time. Tasks are handed out one index at a time, so uneven tasks balance
+ * themselves across the threads.
+ */
+class ThreadPool {
+
+public:
+  /**
+   * ThreadPool constructor.
+   * @param number_of_threads threads that run tasks, counting the thread
+   *        that calls ParallelFor(); at least 1
+   */
+  explicit ThreadPool(size_t number_of_threads);
+
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /**
+   * Runs task(0) to task(count - 1) on the pool and waits for all of them.
+   * The calling thread runs tasks too.
+   *
+   * @param count number of tasks
+   * @param task function called with the index of each task
+   * @throws the first exception a task threw, once every task has finished
+   */
+  void ParallelFor(size_t count, const std::function<void(size_t)> &task);
+
+  // Getters
+  size_t GetNumberOfThreads() const;
+
+private:
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable work_ready_;
+  std::condition_variable work_done_;
+
+  // the current ParallelFor(), guarded by mutex_
+  const std::function<void(size_t)> *task_;
+  size_t task_count_;
+  size_t next_task_;
+  size_t running_workers_;
+  size_t generation_;
+  std::exception_ptr error_;
+  bool stopping_;
+
+  /**
+   * Loop of every worker thread.
+   */
+  void WorkerLoop();
+
+  /**
+   * Runs tasks of the current ParallelFor() until none are left.
+   *
+   * @param lock lock on mutex_, held on entry and on return
+   */
+  void RunTasks(std::unique_lock<std::mutex> &lock);
+};
+
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Trace hooks. NAIVEBAYES_TRACE_SCOPE(name) times the rest of the enclosing
+// block and NAIVEBAYES_TRACE_COUNTER(name, value) samples a counter. Unless
+// NAIVEBAYES_TRACING is defined (the NAIVEBAYES_TRACING CMake option), both
+// compile to nothing and their arguments are not evaluated. Names must be
+// string literals.
+#ifdef NAIVEBAYES_TRACING
+#define NAIVEBAYES_TRACE_CONCAT_INNER(a, b) a##b
+#define NAIVEBAYES_TRACE_CONCAT(a, b) NAIVEBAYES_TRACE_CONCAT_INNER(a, b)
+#define NAIVEBAYES_TRACE_SCOPE(name) \
+  ::naivebayes::TraceScope NAIVEBAYES_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define NAIVEBAYES_TRACE_COUNTER(name, value) \
+  ::naivebayes::Tracer::Get().RecordCounter(name, (double)(value))
+#else
+#define NAIVEBAYES_TRACE_SCOPE(name) \
+  do {                               \
+  } while (0)
+#define NAIVEBAYES_TRACE_COUNTER(name, value) \
+  do {                                        \
+  } while (0)
+#endif
+
+namespace naivebayes {
+
+/**
+ * Collects the timed scopes and counter samples of the trace hooks, from
+ * any thread, and writes them in the Chrome trace event format, which
+ * chrome://tracing and Perfetto open.
+ */
+class Tracer {
+
+public:
+#ifdef NAIVEBAYES_TRACING
+  static constexpr bool kEnabled = true;
+#else
+  static constexpr bool kEnabled = false;
+#endif
+
+  /**
+   * The tracer the hooks record into.
+   */
+  static Tracer &Get();
+
+  /**
+   * Records a timed scope of the calling thread.
+   *
+   * @param name name of the scope, which must outlive the tracer
+   * @param start_nanoseconds start, from Now()
+   * @param end_nanoseconds end, from Now()
+   */
+  void RecordScope(const char *name, uint64_t start_nanoseconds,
+                   uint64_t end_nanoseconds);
+
+  /**
+   * Records the value of a counter at the current time.
+   *
+   * @param name name of the counter, which must outlive the tracer
+   * @param value value of the counter
+   */
+  void RecordCounter(const char *name, double value);
+
+  /**
+   * Writes every recorded event as a Chrome trace JSON file.
+   *
+   * @param file_path path of the file
+   * @throws std::invalid_argument if the file cannot be written
+   */
+  void WriteChromeTrace(const std::string &file_path) const;
+
+  /**
+   * Formats every recorded event as Chrome trace JSON.
+   *
+   * @return the JSON
+   */
+  std::string FormatChromeTrace() const;
+
+  /**
+   * Discards every recorded event.
+   */
+  void Clear();
+
+  /**
+   * Time since the tracer was created.
+   *
+   * @return nanoseconds
+   */
+  uint64_t Now() const;
+
+  // Getters
+  size_t GetNumberOfEvents() const;
+
+  /**
+   * Number of events not recorded because the tracer was full.
+   */
+  size_t GetDroppedEvents() const;
+
+private:
+  struct Event {
+    const char *name;
+    // 'X' for a timed scope, 'C' for a counter sample
+    char phase;
+    uint32_t thread;
+    uint64_t timestamp;
+    uint64_t duration;
+    double value;
+  };
+
+  Tracer();
+
+  std::chrono::steady_clock::time_point start_;
+
+  mutable std::mutex mutex_;
+  std::vector<Event> events_;
+  size_t dropped_events_;
+
+  // events kept at most, so that tracing a long run stays bounded
+  static const size_t kMaxEvents = 1 << 20;
+
+  /**
+   * Stores an event, unless the tracer is full.
+   *
+   * @param event the event
+   */
+  void Record(const Event &event);
+
+  /**
+   * Small number identifying the calling thread in the trace.
+   */
+  static uint32_t ThreadNumber();
+};
+
+/**
+ * Records the time from its construction to its destruction as a scope.
+ */
+class TraceScope {
+
+public:
+  /**
+   * TraceScope constructor.
+   * @param name name of the scope, which must outlive the tracer
+   */
+  explicit TraceScope(const char *name);
+
+  ~TraceScope();
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+  const char *name_;
+  uint64_t start_;
+};
+
+}
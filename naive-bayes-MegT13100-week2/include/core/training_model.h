@@ -1,7 +1,13 @@
 #pragma once
 
+#include "aligned_allocator.h"
+#include "class_index.h"
 #include "data.h"
+#include "feature_counts.h"
+#include "feature_probability_view.h"
 #include "image.h"
+#include "model_file.h"
+#include "scoring_tables.h"
 #include <fstream>
 #include <iostream>
 #include <istream>
@@ -19,8 +25,11 @@ public:
   /**
    * TrainingModel constructor that takes in a Data reference.
    * @param data Data reference
+   * @param number_of_threads number of threads used to count the images
+   * @param counting_kernel how the images are counted
    */
-  explicit TrainingModel(Data &data);
+  explicit TrainingModel(Data &data, size_t number_of_threads = 1,
+                         CountingKernel counting_kernel = kImageLoopCounting);
 
   /**
    * TrainingModel constructor that takes in an image size.
@@ -29,12 +38,13 @@ public:
   TrainingModel(const size_t image_size);
 
   /**
-   * Initializes feature_probability_vector_.
+   * Initializes the flat feature probability table to zero for every class.
    */
-  void InitializeFeatureProbVector();
+  void InitializeFeatureProbTable();
 
   /**
-    * >> overload.
+    * >> overload. Reads a model in the text format, which is the rest of the
+    * stream.
     *
     * @param is input stream
     * @param training_model TrainingModel reference
@@ -43,7 +53,8 @@ public:
   friend std::istream& operator>>(std::istream &is, TrainingModel &training_model);
 
   /**
-   * << overload.
+   * << overload. Writes the model in the text format, with every
+   * probability in the shortest form that reads back to the same double.
    *
    * @param os output stream
    * @param training_model TrainingModel reference
@@ -52,72 +63,392 @@ public:
   friend std::ostream& operator<<(std::ostream &os, TrainingModel &training_model);
 
   /**
-    * Sets the prior probabilities map.
+   * Loads a model in the text format straight from a memory-mapped file.
+   *
+   * @param file_path path of the file
+   * @throws std::invalid_argument if the file cannot be read or parsed
+   */
+  void LoadTextModel(const std::string &file_path);
+
+  /**
+   * Saves the model in the text format with a single write.
+   *
+   * @param file_path path of the file
+   */
+  void SaveTextModel(const std::string &file_path) const;
+
+  /**
+   * Saves the model in the binary model file format: the class table,
+   * priors, probabilities and scoring tables, plus the counts when the
+   * model has them.
+   *
+   * @param file_path path of the file
+   */
+  void SaveModelFile(const std::string &file_path) const;
+
+  /**
+   * Loads a binary model file saved with SaveModelFile(). The file is
+   * memory-mapped and its tables are copied as they are, without parsing or
+   * recomputing any logs.
+   *
+   * @param file_path path of the file
+   * @throws std::invalid_argument if the file is invalid or its image size
+   *         differs from the model's
+   */
+  void LoadModelFile(const std::string &file_path);
+
+  /**
+    * Sets the prior probabilities from the class counts.
     */
-  void SetPriorProbabilities(Data &data);
+  void SetPriorProbabilities();
 
   /**
-    * Sets the feature probabilities vector.
+    * Sets the feature probabilities table.
+    *
+    * @param data Data reference
+    * @param number_of_threads number of threads used to count the images
+    * @param counting_kernel how the images are counted
     */
-  void ComputeFeatureProbabilities(Data &data);
+  void ComputeFeatureProbabilities(
+      Data &data, size_t number_of_threads = 1,
+      CountingKernel counting_kernel = kImageLoopCounting);
 
   /**
+   * Counts the images of every class and their shaded pixels. The images
+   * are split between the threads, each thread counts into its own shard,
+   * and the shards are merged in thread order, so the result does not
+   * depend on the number of threads.
    *
-   * @param pixels
-   * @return
+   * @param data Data reference
+   * @param number_of_threads number of threads to use
+   * @param counting_kernel how the images are counted
+   * @return the counts
    */
-  int Classification(const vector<vector<size_t>>& pixels);
+  FeatureCounts CountFeatures(
+      const Data &data, size_t number_of_threads,
+      CountingKernel counting_kernel = kImageLoopCounting) const;
 
   /**
-   * Underflow calculation.
+   * Counts one more labelled image. Only the counts are updated here; the
+   * probabilities of the classes that changed are recomputed by the next
+   * call to UpdateProbabilities(). An unseen label adds a new class. Until
+   * that call, classifying, scoring, saving and the probability getters
+   * throw std::logic_error.
    *
-   * @param data Data reference
-   * @param image_number label of the image
-   * @return
+   * @param label class number
+   * @param image Image view, with the same image size as the model
+   * @throws std::invalid_argument if the image is not of the model's size
+   */
+  void AddExample(size_t label, const Image &image);
+  void AddExample(size_t label, const vector<vector<size_t>> &pixels);
+
+  /**
+   * Uncounts a labelled image that was previously trained on or added. Like
+   * AddExample(), takes effect on the next UpdateProbabilities().
+   *
+   * @param label class number
+   * @param image Image view, with the same image size as the model
+   * @throws std::invalid_argument if the image is not of the model's size
+   */
+  void RemoveExample(size_t label, const Image &image);
+  void RemoveExample(size_t label, const vector<vector<size_t>> &pixels);
+
+  /**
+   * Trains on a stream of records in the data set format, counting each
+   * image as soon as it is parsed. Only one record is held at a time, so
+   * memory does not depend on the size of the data set. The counts are
+   * added to the ones the model already has, and the probabilities are
+   * updated once the stream ends.
+   *
+   * @param is input stream of records
+   * @return number of images trained on
+   * @throws std::invalid_argument if a record is malformed
+   */
+  size_t Train(std::istream &is);
+
+  /**
+   * Streams the records of a data set file into Train(). With more than one
+   * thread, reading, parsing and counting run as a TrainingPipeline, with
+   * number_of_threads - 1 parser threads.
+   *
+   * @param file_path path of the file
+   * @param number_of_threads number of threads to use
+   * @return number of images trained on
+   * @throws std::invalid_argument if the file cannot be opened or a record
+   *         is malformed
    */
-  double Underflow(const vector<vector<size_t>>& pixels, size_t image_number);
+  size_t TrainFile(const std::string &file_path, size_t number_of_threads = 1);
+
+  /**
+   * Recomputes the probabilities and scoring tables of the classes whose
+   * counts changed since the last update, and the priors of every class.
+   */
+  void UpdateProbabilities();
+
+  /**
+   * Classifies a packed image, touching only its shaded pixels.
+   *
+   * The const inference methods (Classification, Underflow,
+   * ClassifyShadedPixels and ClassifyBatch) only read the model, so any
+   * number of threads may call them on one shared model at once, as long
+   * as no thread trains or loads it meanwhile. Classification and Underflow
+   * do not allocate for models of up to 256 classes.
+   *
+   * @param image Image view
+   * @return the most likely label, or -1 if the model has no classes
+   * @throws std::invalid_argument if the image is not of the model's size
+   * @throws std::logic_error if there are counts UpdateProbabilities() has
+   *         not applied
+   */
+  int Classification(const Image &image) const;
+  int Classification(const vector<vector<size_t>>& pixels) const;
+
+  /**
+   * Classifies an image given only the row major indices of its shaded
+   * pixels. Every other pixel is taken to be unshaded.
+   *
+   * @param shaded_pixels indices of the shaded pixels
+   * @return the most likely label, or -1 if the model has no classes
+   * @throws std::invalid_argument if an index is outside the image
+   */
+  int ClassifyShadedPixels(const vector<size_t> &shaded_pixels) const;
+
+  /**
+   * Classifies every image of a data set.
+   *
+   * @param data Data reference, with the same image size as the model
+   * @return the most likely label of each image, in order
+   */
+  vector<int> ClassifyBatch(const Data &data) const;
+
+  /**
+   * Classifies a contiguous buffer of packed images, laid out like Data
+   * stores them. See ScoringTables::ClassifyBatch().
+   *
+   * @param images packed images, one after the other
+   * @param count number of images
+   * @param predictions output, the most likely label of each image
+   */
+  void ClassifyBatch(const uint64_t *images, size_t count,
+                     int *predictions) const;
+
+  /**
+   * ClassifyBatch() with the caller's working memory, so that classifying
+   * batch after batch does not allocate.
+   *
+   * @param images packed images, one after the other
+   * @param count number of images
+   * @param predictions output, the most likely label of each image
+   * @param scratch working memory, used by one thread at a time
+   */
+  void ClassifyBatch(const uint64_t *images, size_t count, int *predictions,
+                     BatchScratch &scratch) const;
+
+  /**
+   * Underflow calculation: the log posterior of an image for one class,
+   * without normalization, and without any output. It is recomputed in
+   * double precision from the log priors and per-class pixel deltas, while
+   * classification takes the argmax over float scoring tables, so on near
+   * ties the class with the highest Underflow can differ from the label
+   * Classification returns.
+   *
+   * @param pixels pixel vector
+   * @param image_number label of the class
+   * @return log prior plus the log likelihood of the pixels
+   * @throws std::out_of_range if the model has no such class
+   * @throws std::invalid_argument if the image is not of the model's size
+   * @throws std::logic_error if there are counts UpdateProbabilities() has
+   *         not applied
+   */
+  double Underflow(const vector<vector<size_t>>& pixels,
+                   size_t image_number) const;
 
   //Getters
-  std::map<size_t, double> GetPriorProbabilities();
+  /**
+   * Prior probability of every label, built from the prior array.
+   */
+  std::map<size_t, double> GetPriorProbabilities() const;
 
-  vector<vector<vector<std::map<size_t, double>>>> GetFeatureProbabilities();
+  /**
+   * Prior probability of every class, by class index.
+   */
+  const vector<double> &GetPriors() const;
 
-  const Data &GetData();
+  FeatureProbabilityView GetFeatureProbabilities() const;
+
+  const vector<size_t> &GetLabels() const;
+
+  const ClassIndex &GetClassIndex() const;
+
+  const vector<double> &GetLogPriors() const;
+
+  /**
+   * View of the tables the model is scored with, valid until the model
+   * changes.
+   *
+   * @throws std::logic_error if there are counts UpdateProbabilities() has
+   *         not applied
+   */
+  ScoringTables GetScoringTables() const;
+
+  const FeatureCounts &GetCounts() const;
+
+  /**
+   * Whether the model knows its counts. Models read with >> only have
+   * probabilities and cannot be updated incrementally.
+   */
+  bool HasCounts() const;
+
+  const Data &GetData() const;
 
 private:
   // Data variable
   Data data_;
 
-  // vectors
-  vector<vector<vector<std::map<size_t, double>>>> feature_probability_vector_;
-  std::vector<size_t> labels_;
+  // flat table laid out as [class][pixel][shade]
+  vector<double, AlignedAllocator<double>> feature_probabilities_;
+
+  // Bernoulli scoring tables: log P(x | c) is the class baseline, the sum of
+  // log P(unshaded) over every pixel, plus the [class][pixel] log-odds delta
+  // log P(shaded) - log P(unshaded) of each shaded pixel
+  vector<double> unshaded_baselines_;
+  vector<double, AlignedAllocator<double>> shaded_deltas_;
+
+  // the same deltas interleaved as [pixel][class] floats for the scoring
+  // kernels, each row padded to lane_count_ lanes, and the per-class starting
+  // score (log prior plus baseline)
+  size_t lane_count_ = 0;
+  vector<float, AlignedAllocator<float>> interleaved_weights_;
+  vector<float, AlignedAllocator<float>> class_biases_;
+
+  // dense class index, with the labels in ascending order once the
+  // probabilities are up to date; every per-class array is indexed by it
+  ClassIndex class_index_;
+  vector<double> priors_;
+  vector<double> log_priors_;
+
+  // sufficient statistics the probabilities are computed from
+  FeatureCounts counts_;
+  bool has_counts_;
 
-  // maps
-  std::map<size_t, double> prior_probability_map_;
-  std::map<size_t, int> class_count_;
+  // classes whose counts changed since the probabilities were computed
+  vector<bool> stale_classes_;
+  bool has_stale_classes_ = false;
 
 
   // Constant variables
-  const double kNumberOfShades = 2.0;
+  static const size_t kNumberOfShades = 2;
   const double kSmoothingConstant = 1.0;
   const char kSpace = ' ';
 
+  /**
+   * Parses a model in the text format: the number of classes, a label and
+   * prior per class, then for each pixel and shade the probability of every
+   * class. Numbers are read with std::from_chars, which does not depend on
+   * the locale.
+   *
+   * @param begin start of the text
+   * @param end end of the text
+   */
+  void ParseTextModel(const char *begin, const char *end);
+
+  /**
+   * Formats the model in the text format with std::to_chars.
+   *
+   * @return the text
+   */
+  std::string FormatTextModel() const;
+
+  /**
+   * Builds the dense class index from the given labels, in ascending order.
+   *
+   * @param labels labels present in the data
+   */
+  void SetClassIndex(const vector<size_t> &labels);
+
+  /**
+   * Computes the log priors, the unshaded baselines, the shaded deltas and
+   * the interleaved weights, so that scoring never has to call log().
+   */
+  void ComputeLogProbabilities();
+
+  /**
+   * Computes the feature probabilities of one class from its counts.
+   *
+   * @param class_index dense index of the class
+   */
+  void ComputeClassProbabilities(size_t class_index);
+
+  /**
+   * Computes the baseline, deltas and interleaved weights of one class.
+   *
+   * @param class_index dense index of the class
+   */
+  void ComputeClassLogProbabilities(size_t class_index);
+
+  /**
+   * Computes the log priors and the starting score of every class.
+   */
+  void ComputeLogPriors();
+
+  /**
+   * Adds a class for a new label after the last one. The class index is
+   * sorted again, and the tables resized, by UpdateProbabilities().
+   *
+   * @param label the new label
+   * @return dense index of the new class
+   */
+  size_t AddClass(size_t label);
+
+  /**
+   * Puts the classes back in ascending label order, moving their counts.
+   */
+  void SortClasses();
+
+  /**
+   * Checks that the probabilities and tables include every count, which
+   * AddExample() and RemoveExample() leave to UpdateProbabilities(). Until
+   * then, a new class has no entry in the tables.
+   *
+   * @throws std::logic_error if they do not
+   */
+  void CheckProbabilitiesAreCurrent() const;
+
+  /**
+   * Checks that an image can be used with this model.
+   *
+   * @param image Image view
+   */
+  void CheckImageSize(const Image &image) const;
+  void CheckImageSize(const vector<vector<size_t>> &pixels) const;
+
+  /**
+   * Position of a probability in the flat tables.
+   *
+   * @param class_index dense index of the class
+   * @param pixel row major pixel index
+   * @param shade shade of the pixel
+   * @return offset into the flat tables
+   */
+  size_t TableIndex(size_t class_index, size_t pixel, size_t shade) const;
+
   /**
     * Computes the prior probability.
     *
-    * @param class_value
-    * @return
+    * @param class_index dense index of the class
+    * @return the prior probability of the class
     */
-  double ComputePriorProbabilities(size_t class_number);
+  double ComputePriorProbabilities(size_t class_index);
 
   /**
    * Underflow helper.
    *
-   * @param data Data reference
-   * @param image_number label of the image
+   * @param pixels pixel vector
+   * @param class_index dense index of the class
    * @return double representing the sum of all the logs of the feature probabilities.
    */
-  double UnderflowHelper(const vector<vector<size_t>>& pixels, size_t image_number);
+  double UnderflowHelper(const vector<vector<size_t>> &pixels,
+                         size_t class_index) const;
 
 };
 
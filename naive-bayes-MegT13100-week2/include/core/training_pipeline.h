@@ -0,0 +1,119 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "bounded_queue.h"
+#include "data.h"
+#include "training_model.h"
+
+namespace naivebayes {
+
+/**
+ * Trains a model from a stream of records with reading, parsing and counting
+ * overlapped. A reader thread cuts the stream into blocks of whole records,
+ * parser threads turn blocks into batches of packed images, and the calling
+ * thread counts the batches into the model. The queues between the stages
+ * are bounded, so memory stays the same whatever the size of the stream and
+ * the wall time follows the slowest stage.
+ */
+class TrainingPipeline {
+
+public:
+  /**
+   * TrainingPipeline constructor.
+   * @param model TrainingModel to train; must have counts
+   * @param number_of_parsers number of parser threads
+   * @param block_bytes bytes read into each block, rounded up to whole
+   *        records
+   * @param queue_capacity blocks or batches each queue holds
+   */
+  TrainingPipeline(TrainingModel &model, size_t number_of_parsers,
+                   size_t block_bytes = kDefaultBlockBytes,
+                   size_t queue_capacity = kDefaultQueueCapacity);
+
+  /**
+   * Trains the model on every record of the stream, then updates its
+   * probabilities.
+   *
+   * @param is input stream of records
+   * @return number of images trained on
+   * @throws std::invalid_argument for the first malformed record in the
+   *         stream; the images of the blocks before its block may already
+   *         be counted, those after it are not
+   */
+  size_t Run(std::istream &is);
+
+  static const size_t kDefaultBlockBytes = 1 << 20;
+  static const size_t kDefaultQueueCapacity = 4;
+
+private:
+  /**
+   * Whole records read from the stream.
+   */
+  struct Block {
+    std::string text;
+    size_t first_line_number;
+    size_t sequence;
+  };
+
+  /**
+   * Images parsed from one block.
+   */
+  struct Batch {
+    std::unique_ptr<Data> data;
+    size_t sequence;
+  };
+
+  TrainingModel &model_;
+  size_t image_size_;
+  size_t number_of_parsers_;
+  size_t block_bytes_;
+  size_t queue_capacity_;
+
+  // set once any stage fails, so that the reader stops early
+  std::atomic<bool> stopping_;
+
+  // the error of the earliest failing block, guarded by error_mutex_
+  std::mutex error_mutex_;
+  std::exception_ptr error_;
+  size_t error_sequence_;
+
+  /**
+   * Reads the stream into blocks that end on record boundaries.
+   *
+   * @param is input stream
+   * @param blocks queue to the parsers
+   */
+  void ReadBlocks(std::istream &is, BoundedQueue<Block> &blocks);
+
+  /**
+   * Parses blocks into batches until the blocks run out.
+   *
+   * @param blocks queue from the reader
+   * @param batches queue to the counting stage
+   */
+  void ParseBlocks(BoundedQueue<Block> &blocks, BoundedQueue<Batch> &batches);
+
+  /**
+   * Remembers an error if it comes before every error seen so far.
+   *
+   * @param error the error
+   * @param sequence sequence number of the block it happened in
+   */
+  void RecordError(std::exception_ptr error, size_t sequence);
+
+  /**
+   * Tells whether a block comes after the earliest error seen so far, so
+   * that it is neither parsed nor counted.
+   *
+   * @param sequence sequence number of the block
+   * @return true if an earlier block failed
+   */
+  bool IsAfterError(size_t sequence);
+};
+
+}
@@ -4,7 +4,7 @@
 #include "cinder/app/RendererGl.h"
 #include "cinder/gl/gl.h"
 #include "sketchpad.h"
-#include <core/training_model.h>
+#include <core/model_holder.h>
 
 namespace naivebayes {
 
@@ -31,9 +31,18 @@ class NaiveBayesApp : public ci::app::App {
 
  private:
   Sketchpad sketchpad_;
-  TrainingModel trainer_;
+  // reloaded in the background without blocking predictions
+  ModelHolder model_;
   int current_prediction_ = -1;
 
+  /**
+   * Path of the model to load: the binary model file if there is one, and
+   * the text model otherwise.
+   *
+   * @return the path
+   */
+  static std::string ModelPath();
+
 };
 
 }  // namespace visualizer
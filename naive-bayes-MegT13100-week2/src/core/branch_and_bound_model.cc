@@ -0,0 +1,297 @@
+#include <core/bit_operations.h>
+#include <core/branch_and_bound_model.h>
+#include <core/scoring_kernel.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+
+namespace naivebayes {
+
+const size_t BranchAndBoundModel::kBoundInterval;
+const size_t BranchAndBoundModel::kMaxStackLanes;
+const size_t BranchAndBoundModel::kMaxStackPixels;
+const size_t BranchAndBoundModel::kClassByClassRatio;
+
+BranchAndBoundModel::BranchAndBoundModel(const ScoringTables &tables)
+    : image_size_(tables.GetImageSize()),
+      number_of_pixels_(image_size_ * image_size_),
+      number_of_classes_(tables.GetNumberOfClasses()),
+      lane_count_(tables.GetLaneCount()),
+      number_of_rounds_((number_of_pixels_ + kBoundInterval - 1) /
+                        kBoundInterval) {
+  size_t classes = number_of_classes_;
+  const float *weights = tables.GetInterleavedWeights();
+  labels_.assign(tables.GetLabels(), tables.GetLabels() + classes);
+  biases_.assign(tables.GetClassBiases(),
+                 tables.GetClassBiases() + lane_count_);
+
+  // the pixels whose weights are the most spread out between the classes
+  // separate them the most, so they are scanned first
+  vector<float> spreads(number_of_pixels_, 0.0f);
+  for (size_t p = 0; p < number_of_pixels_ && classes > 0; p++) {
+    const float *row = weights + p * lane_count_;
+    spreads[p] = *std::max_element(row, row + classes) -
+                 *std::min_element(row, row + classes);
+  }
+  pixel_order_.resize(number_of_pixels_);
+  for (size_t p = 0; p < number_of_pixels_; p++) {
+    pixel_order_[p] = p;
+  }
+  std::stable_sort(pixel_order_.begin(), pixel_order_.end(),
+                   [&spreads](size_t a, size_t b) {
+                     return spreads[a] > spreads[b];
+                   });
+
+  scan_positions_.resize(number_of_pixels_);
+  ordered_weights_.resize(number_of_pixels_ * lane_count_);
+  class_weights_.resize(classes * number_of_pixels_);
+  for (size_t k = 0; k < number_of_pixels_; k++) {
+    size_t pixel = pixel_order_[k];
+    scan_positions_[pixel] = k;
+    std::copy(weights + pixel * lane_count_,
+              weights + (pixel + 1) * lane_count_,
+              ordered_weights_.begin() + k * lane_count_);
+    for (size_t c = 0; c < classes; c++) {
+      class_weights_[c * number_of_pixels_ + k] =
+          weights[pixel * lane_count_ + c];
+    }
+  }
+
+  // suffix bounds, from the last round back
+  size_t table_size = (number_of_rounds_ + 1) * lane_count_;
+  positive_sums_.assign(table_size, 0.0f);
+  negative_sums_.assign(table_size, 0.0f);
+  highest_weights_.assign(table_size, 0.0f);
+  lowest_weights_.assign(table_size, 0.0f);
+  for (size_t round = number_of_rounds_; round-- > 0;) {
+    size_t begin = round * kBoundInterval;
+    size_t end = std::min(number_of_pixels_, begin + kBoundInterval);
+    for (size_t c = 0; c < classes; c++) {
+      size_t next = (round + 1) * lane_count_ + c;
+      double positive_sum = positive_sums_[next];
+      double negative_sum = negative_sums_[next];
+      float highest = highest_weights_[next];
+      float lowest = lowest_weights_[next];
+      for (size_t k = begin; k < end; k++) {
+        float weight = ordered_weights_[k * lane_count_ + c];
+        positive_sum += std::max(weight, 0.0f);
+        negative_sum += std::min(weight, 0.0f);
+        highest = std::max(highest, weight);
+        lowest = std::min(lowest, weight);
+      }
+      positive_sums_[round * lane_count_ + c] = (float)positive_sum;
+      negative_sums_[round * lane_count_ + c] = (float)negative_sum;
+      highest_weights_[round * lane_count_ + c] = highest;
+      lowest_weights_[round * lane_count_ + c] = lowest;
+    }
+  }
+
+  // a float sum of n terms is within n * FLT_EPSILON / 2 of their exact
+  // sum, relative to the sum of their magnitudes. Scores and bounds each
+  // take fewer than number_of_pixels_ + 4 roundings, none larger than the
+  // magnitude of a class; the factor of four covers the score and bound of
+  // both classes in a comparison
+  double largest_magnitude = 0.0;
+  for (size_t c = 0; c < classes; c++) {
+    largest_magnitude = std::max<double>(
+        largest_magnitude,
+        std::fabs(biases_[c]) + positive_sums_[c] - negative_sums_[c]);
+  }
+  rounding_margin_ = (float)(4.0 * (number_of_pixels_ + 4) * FLT_EPSILON *
+                             largest_magnitude);
+}
+
+int BranchAndBoundModel::Classify(const uint64_t *image_words,
+                                  BranchAndBoundStats *stats) const {
+  size_t classes = number_of_classes_;
+  alignas(64) float stack_scores[kMaxStackLanes];
+  size_t stack_candidates[kMaxStackLanes];
+  uint64_t stack_positions[kMaxStackPixels / Image::kBitsPerWord];
+  vector<float> heap_scores;
+  vector<size_t> heap_candidates;
+  vector<uint64_t> heap_positions;
+  float *scores = stack_scores;
+  size_t *candidates = stack_candidates;
+  uint64_t *positions = stack_positions;
+  if (lane_count_ > kMaxStackLanes) {
+    heap_scores.resize(lane_count_);
+    heap_candidates.resize(lane_count_);
+    scores = heap_scores.data();
+    candidates = heap_candidates.data();
+  }
+  size_t position_words =
+      (number_of_pixels_ + Image::kBitsPerWord - 1) / Image::kBitsPerWord;
+  if (number_of_pixels_ > kMaxStackPixels) {
+    heap_positions.resize(position_words);
+    positions = heap_positions.data();
+  }
+
+  // the scan positions of the shaded pixels, as bits
+  std::fill(positions, positions + position_words, 0);
+  size_t words_per_row = Image::WordsPerRow(image_size_);
+  for (size_t i = 0; i < image_size_; i++) {
+    for (size_t w = 0; w < words_per_row; w++) {
+      uint64_t word = image_words[i * words_per_row + w];
+      while (word != 0) {
+        size_t pixel = i * image_size_ + w * Image::kBitsPerWord +
+                       CountTrailingZeros(word);
+        size_t position = scan_positions_[pixel];
+        positions[position / Image::kBitsPerWord] |=
+            uint64_t(1) << (position % Image::kBitsPerWord);
+        word &= word - 1;
+      }
+    }
+  }
+
+  size_t remaining = 0;
+  for (size_t w = 0; w < position_words; w++) {
+    remaining += PopCount(positions[w]);
+  }
+  for (size_t lane = 0; lane < lane_count_; lane++) {
+    scores[lane] = biases_[lane];
+  }
+
+  // candidates are kept in ascending class order, so ties go to the lower
+  // class index as in ScoringTables
+  for (size_t c = 0; c < classes; c++) {
+    candidates[c] = c;
+  }
+  size_t candidate_count = classes;
+  size_t completed_class = classes;
+  float completed_score = -std::numeric_limits<float>::infinity();
+  size_t round = 0;
+  while (candidate_count > 1 && round < number_of_rounds_) {
+    size_t rows[kBoundInterval];
+    size_t count = 0;
+    size_t first = round * kBoundInterval;
+    uint64_t word = RoundBits(positions, round);
+    while (word != 0) {
+      rows[count++] = first + CountTrailingZeros(word);
+      word &= word - 1;
+    }
+    if (candidate_count * kClassByClassRatio >= lane_count_) {
+      AccumulateRows(ordered_weights_.data(), lane_count_, rows, count,
+                     scores);
+    } else {
+      for (size_t i = 0; i < candidate_count; i++) {
+        size_t c = candidates[i];
+        const float *weights = &class_weights_[c * number_of_pixels_];
+        for (size_t k = 0; k < count; k++) {
+          scores[c] += weights[rows[k]];
+        }
+      }
+    }
+    remaining -= count;
+    round++;
+
+    // bounds on what the shaded pixels left can add
+    const float *positive_sums = &positive_sums_[round * lane_count_];
+    const float *negative_sums = &negative_sums_[round * lane_count_];
+    const float *highest = &highest_weights_[round * lane_count_];
+    const float *lowest = &lowest_weights_[round * lane_count_];
+    float shaded = (float)remaining;
+
+    float threshold = -std::numeric_limits<float>::infinity();
+    size_t leader = candidates[0];
+    for (size_t i = 0; i < candidate_count; i++) {
+      size_t c = candidates[i];
+      float lower_bound = std::max(negative_sums[c], shaded * lowest[c]);
+      threshold = std::max(threshold, scores[c] + lower_bound);
+      if (scores[c] > scores[leader]) {
+        leader = c;
+      }
+    }
+
+    // the final score of the leader is a much tighter threshold than its
+    // lower bound, and costs one class's share of the remaining pixels
+    if (leader != completed_class) {
+      completed_class = leader;
+      completed_score = std::max(
+          completed_score,
+          scores[leader] + RemainingScore(positions, round, leader));
+    }
+    threshold = std::max(threshold, completed_score) - rounding_margin_;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < candidate_count; i++) {
+      size_t c = candidates[i];
+      float upper_bound = std::min(positive_sums[c], shaded * highest[c]);
+      if (!(scores[c] + upper_bound < threshold)) {
+        candidates[kept++] = c;
+      }
+    }
+    candidate_count = kept;
+  }
+
+  if (stats != nullptr) {
+    stats->pixels_scanned =
+        std::min(number_of_pixels_, round * kBoundInterval);
+    stats->classes_rescored = candidate_count > 1 ? candidate_count : 0;
+  }
+  if (candidate_count == 1) {
+    return labels_[candidates[0]];
+  }
+
+  float highest_likelihood = -std::numeric_limits<float>::max();
+  int most_likely = -1;
+  for (size_t i = 0; i < candidate_count; i++) {
+    float score = ExactScore(image_words, candidates[i]);
+    if (score > highest_likelihood) {
+      highest_likelihood = score;
+      most_likely = labels_[candidates[i]];
+    }
+  }
+  return most_likely;
+}
+
+uint64_t BranchAndBoundModel::RoundBits(const uint64_t *positions,
+                                        size_t round) const {
+  size_t first = round * kBoundInterval;
+  return positions[first / Image::kBitsPerWord] >>
+             (first % Image::kBitsPerWord) &
+         ~uint64_t(0) >> (Image::kBitsPerWord - kBoundInterval);
+}
+
+float BranchAndBoundModel::RemainingScore(const uint64_t *positions,
+                                          size_t first_round,
+                                          size_t class_index) const {
+  const float *weights = &class_weights_[class_index * number_of_pixels_];
+  float score = 0.0f;
+  for (size_t round = first_round; round < number_of_rounds_; round++) {
+    uint64_t word = RoundBits(positions, round);
+    while (word != 0) {
+      score += weights[round * kBoundInterval + CountTrailingZeros(word)];
+      word &= word - 1;
+    }
+  }
+  return score;
+}
+
+float BranchAndBoundModel::ExactScore(const uint64_t *image_words,
+                                      size_t class_index) const {
+  size_t words_per_row = Image::WordsPerRow(image_size_);
+  const float *weights = &class_weights_[class_index * number_of_pixels_];
+  float score = biases_[class_index];
+  for (size_t i = 0; i < image_size_; i++) {
+    for (size_t w = 0; w < words_per_row; w++) {
+      uint64_t word = image_words[i * words_per_row + w];
+      while (word != 0) {
+        size_t pixel = i * image_size_ + w * Image::kBitsPerWord +
+                       CountTrailingZeros(word);
+        score += weights[scan_positions_[pixel]];
+        word &= word - 1;
+      }
+    }
+  }
+  return score;
+}
+
+// Getters
+size_t BranchAndBoundModel::GetImageSize() const { return image_size_; }
+
+const vector<size_t> &BranchAndBoundModel::GetPixelOrder() const {
+  return pixel_order_;
+}
+
+}
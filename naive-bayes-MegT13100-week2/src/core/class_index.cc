@@ -0,0 +1,66 @@
+#include <core/class_index.h>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace naivebayes {
+
+const size_t ClassIndex::kNoClass = std::numeric_limits<size_t>::max();
+const size_t ClassIndex::kDirectLabelLimit;
+const uint32_t ClassIndex::kNoDirectClass;
+
+ClassIndex::ClassIndex() {}
+
+ClassIndex::ClassIndex(const vector<size_t> &labels) {
+  for (const size_t &label : labels) {
+    Insert(label);
+  }
+}
+
+size_t ClassIndex::At(size_t label) const {
+  size_t index = Find(label);
+  if (index == kNoClass) {
+    throw std::out_of_range("no class for label " + std::to_string(label));
+  }
+  return index;
+}
+
+size_t ClassIndex::Insert(size_t label) {
+  size_t index = Find(label);
+  if (index != kNoClass) {
+    return index;
+  }
+
+  index = labels_.size();
+  labels_.push_back(label);
+  if (label < kDirectLabelLimit) {
+    if (label >= direct_.size()) {
+      direct_.resize(label + 1, kNoDirectClass);
+    }
+    direct_[label] = (uint32_t)index;
+  } else {
+    large_labels_[label] = index;
+  }
+  return index;
+}
+
+bool ClassIndex::Contains(size_t label) const {
+  return Find(label) != kNoClass;
+}
+
+void ClassIndex::Clear() {
+  labels_.clear();
+  direct_.clear();
+  large_labels_.clear();
+}
+
+// Getters
+size_t ClassIndex::size() const { return labels_.size(); }
+
+bool ClassIndex::empty() const { return labels_.empty(); }
+
+size_t ClassIndex::GetLabel(size_t index) const { return labels_[index]; }
+
+const vector<size_t> &ClassIndex::GetLabels() const { return labels_; }
+
+}
@@ -0,0 +1,143 @@
+#include <core/classifier.h>
+#include <core/scoring_kernel.h>
+#include <core/trace.h>
+#include <stdexcept>
+
+namespace naivebayes {
+
+Classifier::Classifier(const TrainingModel &model)
+    : labels_(model.GetLabels()), priors_(model.GetPriors()),
+      log_priors_(model.GetLogPriors()) {
+  ScoringTables tables = model.GetScoringTables();
+  image_size_ = tables.GetImageSize();
+  lane_count_ = tables.GetLaneCount();
+  size_t number_of_pixels = image_size_ * image_size_;
+  owned_weights_.assign(tables.GetInterleavedWeights(),
+                        tables.GetInterleavedWeights() +
+                            number_of_pixels * lane_count_);
+  owned_biases_.assign(tables.GetClassBiases(),
+                       tables.GetClassBiases() + lane_count_);
+  interleaved_weights_ = owned_weights_.data();
+  class_biases_ = owned_biases_.data();
+  specialized_ = MakeFixedSizeModel(GetScoringTables());
+  branch_and_bound_.reset(new LazyBranchAndBound());
+}
+
+Classifier::Classifier(const std::string &file_path)
+    : file_(new ModelFile(file_path)) {
+  NAIVEBAYES_TRACE_SCOPE("load/classifier");
+  ModelFileSections sections = file_->GetSections();
+  if (sections.lane_count != PaddedLaneCount(sections.number_of_classes)) {
+    throw std::invalid_argument("model file does not match the scoring "
+                                "kernels: " + file_path);
+  }
+
+  image_size_ = sections.image_size;
+  size_t classes = sections.number_of_classes;
+  labels_.assign(sections.labels, sections.labels + classes);
+  priors_.assign(sections.priors, sections.priors + classes);
+  log_priors_.assign(sections.log_priors, sections.log_priors + classes);
+
+  // the big tables stay in the mapping
+  lane_count_ = sections.lane_count;
+  interleaved_weights_ = sections.interleaved_weights;
+  class_biases_ = sections.class_biases;
+  specialized_ = MakeFixedSizeModel(GetScoringTables());
+  branch_and_bound_.reset(new LazyBranchAndBound());
+}
+
+int Classifier::Classify(const Image &image) const {
+  NAIVEBAYES_TRACE_SCOPE("classify/image");
+  if (image.GetImageSize() != image_size_) {
+    throw std::invalid_argument("image size does not match the classifier");
+  }
+  if (specialized_) {
+    return specialized_->Classify(image.GetWords());
+  }
+  return GetScoringTables().Classify(image.GetWords());
+}
+
+int Classifier::Classify(const vector<vector<size_t>> &pixels) const {
+  NAIVEBAYES_TRACE_SCOPE("classify/image");
+  if (pixels.size() != image_size_) {
+    throw std::invalid_argument("image size does not match the classifier");
+  }
+  return GetScoringTables().Classify(pixels);
+}
+
+int Classifier::ClassifyShadedPixels(
+    const vector<size_t> &shaded_pixels) const {
+  return GetScoringTables().ClassifyShadedPixels(shaded_pixels);
+}
+
+int Classifier::ClassifyBranchAndBound(const Image &image,
+                                       BranchAndBoundStats *stats) const {
+  NAIVEBAYES_TRACE_SCOPE("classify/branch_and_bound");
+  if (image.GetImageSize() != image_size_) {
+    throw std::invalid_argument("image size does not match the classifier");
+  }
+  std::call_once(branch_and_bound_->built, [this] {
+    branch_and_bound_->model.reset(
+        new BranchAndBoundModel(GetScoringTables()));
+  });
+  return branch_and_bound_->model->Classify(image.GetWords(), stats);
+}
+
+void Classifier::ClassifyBatch(const uint64_t *images, size_t count,
+                               int *predictions) const {
+  NAIVEBAYES_TRACE_SCOPE("classify/batch");
+  GetScoringTables().ClassifyBatch(images, count, predictions);
+}
+
+void Classifier::ClassifyBatch(const uint64_t *images, size_t count,
+                               int *predictions, BatchScratch &scratch) const {
+  NAIVEBAYES_TRACE_SCOPE("classify/batch");
+  GetScoringTables().ClassifyBatch(images, count, predictions, scratch);
+}
+
+void Classifier::ComputePosteriors(const Image &image,
+                                   double *posteriors) const {
+  NAIVEBAYES_TRACE_SCOPE("classify/posteriors");
+  if (image.GetImageSize() != image_size_) {
+    throw std::invalid_argument("image size does not match the classifier");
+  }
+  GetScoringTables().ComputePosteriors(image.GetWords(), posteriors);
+}
+
+size_t Classifier::FindTopClasses(const Image &image, size_t k,
+                                  ClassProbability *top_classes) const {
+  NAIVEBAYES_TRACE_SCOPE("classify/top_classes");
+  if (image.GetImageSize() != image_size_) {
+    throw std::invalid_argument("image size does not match the classifier");
+  }
+  return GetScoringTables().FindTopClasses(image.GetWords(), k, top_classes);
+}
+
+void Classifier::ComputePosteriorsBatch(const uint64_t *images, size_t count,
+                                        double *posteriors) const {
+  NAIVEBAYES_TRACE_SCOPE("classify/posteriors_batch");
+  GetScoringTables().ComputePosteriorsBatch(images, count, posteriors);
+}
+
+void Classifier::FindTopClassesBatch(const uint64_t *images, size_t count,
+                                     size_t k,
+                                     ClassProbability *top_classes) const {
+  NAIVEBAYES_TRACE_SCOPE("classify/top_classes_batch");
+  GetScoringTables().FindTopClassesBatch(images, count, k, top_classes);
+}
+
+// Getters
+size_t Classifier::GetImageSize() const { return image_size_; }
+
+const vector<size_t> &Classifier::GetLabels() const { return labels_; }
+
+const vector<double> &Classifier::GetPriors() const { return priors_; }
+
+const vector<double> &Classifier::GetLogPriors() const { return log_priors_; }
+
+ScoringTables Classifier::GetScoringTables() const {
+  return ScoringTables(image_size_, labels_.data(), labels_.size(),
+                       lane_count_, interleaved_weights_, class_biases_);
+}
+
+}
@@ -1,31 +1,49 @@
 #include <core/data.h>
 #include <core/file_handler.h>
+#include <core/mapped_file.h>
+#include <core/thread_pool.h>
+#include <core/trace.h>
+#include <algorithm>
+#include <cstring>
+#include <exception>
 #include <fstream>
+#include <stdexcept>
 
 using naivebayes::Pixel;
 using naivebayes::Pixel;
 
 namespace naivebayes {
 
+const size_t Data::kChunksPerThread;
+const size_t Data::kMinChunkBytes;
+
 Data::Data(size_t image_size) {
   image_size_ = image_size;
+  words_per_image_ = image_size * Image::WordsPerRow(image_size);
+
+  std::fill(shade_table_, shade_table_ + 256, (uint8_t)kUnshadedPixel);
+  for (const char &shade : shaded_values) {
+    shade_table_[(unsigned char)shade] = kShadedPixel;
+  }
 }
 
 std::istream &operator>>(std::istream &is, Data &data) {
   std::string str;
   while(std::getline(is, str)) {
 
-    size_t label = (std::stoi(str));
+    size_t label = 0;
+    if (!Data::ParseLabel(str.data(), str.data() + str.size(), label)) {
+      throw std::invalid_argument("invalid label");
+    }
     data.UpdateAmountOfLabels(label);
 
-    vector<std::string> pixels;
+    uint64_t *image_words = data.AppendImage(label);
+    size_t words_per_row = Image::WordsPerRow(data.image_size_);
     for (size_t i = 0; i < data.image_size_; i++) {
       std::getline(is, str);
-      pixels.push_back(str);
+      data.PackRow(str.data(), str.data() + str.size(),
+                   image_words + i * words_per_row);
     }
-    auto image_shades = data.SetPixelVectorForImage(pixels);
-    Image img = Image(label, data.image_size_, image_shades);
-    data.images_.emplace_back(img);
   }
 
   return is;
@@ -36,32 +54,248 @@ void Data::FileReader(std::string file_path, Data &data) {
   file_handler.HandleFile();
 }
 
-void Data::UpdateAmountOfLabels(size_t label) {
-  if (std::count(labels_.begin(), labels_.end(), label) == 0) {
-    labels_.push_back(label);
+void Data::LoadFile(const std::string &file_path, size_t number_of_threads) {
+  NAIVEBAYES_TRACE_SCOPE("parse/load_file");
+  MappedFile file(file_path);
+  ParseBuffer(file.GetData(), file.GetData() + file.GetSize(),
+              number_of_threads);
+}
+
+void Data::ParseBuffer(const char *begin, const char *end,
+                       size_t number_of_threads) {
+  NAIVEBAYES_TRACE_SCOPE("parse/buffer");
+  if (number_of_threads > 1) {
+    ParseChunks(begin, end, number_of_threads);
+  } else {
+    // a record is a label line plus image_size_ rows of image_size_
+    // characters
+    size_t record_bytes = (image_size_ + 1) * image_size_ + 2;
+    size_t expected_images = (end - begin) / record_bytes + 1;
+    image_words_.reserve(image_words_.size() +
+                         expected_images * words_per_image_);
+    image_labels_.reserve(image_labels_.size() + expected_images);
+
+    ParseBlock(begin, end, 1);
   }
+  NAIVEBAYES_TRACE_COUNTER("parse/images", image_labels_.size());
 }
 
-vector<vector<size_t>> Data::SetPixelVectorForImage(vector<std::string> &pixels) const {
-  vector<vector<size_t>> image_shades(image_size_, vector<size_t>(image_size_));
+void Data::ParseBlock(const char *begin, const char *end,
+                      size_t first_line_number) {
+  const char *cursor = begin;
+  size_t line_number = first_line_number;
+  size_t first_image = image_labels_.size();
+  try {
+    while (cursor < end) {
+      uint64_t *image_words = AppendImage(0);
+      cursor = ParseRecord(cursor, end, line_number, image_labels_.back(),
+                           image_words);
+      line_number += image_size_ + 1;
+    }
+  } catch (...) {
+    image_words_.resize(first_image * words_per_image_);
+    image_labels_.resize(first_image);
+    throw;
+  }
 
-  for (size_t i = 0; i < image_size_; i++) {
-    for (size_t j = 0; j < image_size_; j++) {
-      if (std::count(shaded_values.begin(), shaded_values.end(), pixels[i][j])) {
-        image_shades[i][j] = kShadedPixel;
-      } else {
-        image_shades[i][j] = kUnshadedPixel;
+  for (size_t image = first_image; image < image_labels_.size(); image++) {
+    UpdateAmountOfLabels(image_labels_[image]);
+  }
+}
+
+void Data::ParseChunks(const char *begin, const char *end,
+                       size_t number_of_threads) {
+  NAIVEBAYES_TRACE_SCOPE("parse/chunks");
+  ThreadPool pool(number_of_threads);
+  size_t lines_per_record = image_size_ + 1;
+
+  // split the bytes evenly and count the line breaks in every chunk, which
+  // tells which records start in which chunk
+  size_t number_of_chunks = std::max<size_t>(
+      1, std::min<size_t>(number_of_threads * kChunksPerThread,
+                          (end - begin) / kMinChunkBytes));
+  size_t chunk_bytes = (end - begin) / number_of_chunks;
+  vector<const char *> chunk_begins(number_of_chunks + 1);
+  for (size_t k = 0; k < number_of_chunks; k++) {
+    chunk_begins[k] = begin + k * chunk_bytes;
+  }
+  chunk_begins[number_of_chunks] = end;
+
+  vector<size_t> line_breaks(number_of_chunks + 1, 0);
+  pool.ParallelFor(number_of_chunks, [&](size_t k) {
+    size_t count = 0;
+    const char *cursor = chunk_begins[k];
+    while ((cursor = static_cast<const char *>(
+                memchr(cursor, '\n', chunk_begins[k + 1] - cursor))) !=
+           nullptr) {
+      count++;
+      cursor++;
+    }
+    line_breaks[k + 1] = count;
+  });
+
+  // line_breaks[k] becomes the number of line breaks before chunk k
+  for (size_t k = 0; k < number_of_chunks; k++) {
+    line_breaks[k + 1] += line_breaks[k];
+  }
+  size_t number_of_lines = line_breaks[number_of_chunks] +
+                           (begin != end && *(end - 1) != '\n');
+  size_t number_of_records =
+      (number_of_lines + lines_per_record - 1) / lines_per_record;
+
+  // record r starts on line r * lines_per_record, right after the line break
+  // before it; it belongs to the chunk that holds that line break
+  vector<size_t> first_records(number_of_chunks + 1, number_of_records);
+  first_records[0] = 0;
+  for (size_t k = 1; k < number_of_chunks; k++) {
+    first_records[k] = std::min(
+        number_of_records,
+        (line_breaks[k] + lines_per_record) / lines_per_record);
+  }
+
+  // every chunk parses its records straight into their place
+  size_t first_image = image_labels_.size();
+  image_words_.resize(image_words_.size() + number_of_records * words_per_image_,
+                      0);
+  image_labels_.resize(image_labels_.size() + number_of_records, 0);
+  vector<ClassIndex> chunk_labels(number_of_chunks);
+  vector<std::exception_ptr> errors(number_of_chunks);
+  pool.ParallelFor(number_of_chunks, [&](size_t k) {
+    if (first_records[k] >= first_records[k + 1]) {
+      return;
+    }
+    try {
+      // skip to the line break that ends the line before the first record
+      const char *cursor = chunk_begins[k];
+      if (first_records[k] > 0) {
+        size_t skip = first_records[k] * lines_per_record - 1 - line_breaks[k];
+        for (size_t i = 0; i <= skip; i++) {
+          cursor = static_cast<const char *>(
+                       memchr(cursor, '\n', end - cursor)) + 1;
+        }
+      }
+
+      for (size_t r = first_records[k]; r < first_records[k + 1]; r++) {
+        size_t image = first_image + r;
+        cursor = ParseRecord(cursor, end, r * lines_per_record + 1,
+                             image_labels_[image],
+                             &image_words_[image * words_per_image_]);
+        chunk_labels[k].Insert(image_labels_[image]);
       }
+    } catch (...) {
+      errors[k] = std::current_exception();
+    }
+  });
+
+  // the first error in the file is the one a single thread would have hit
+  for (size_t k = 0; k < number_of_chunks; k++) {
+    if (errors[k]) {
+      image_words_.resize(first_image * words_per_image_);
+      image_labels_.resize(first_image);
+      std::rethrow_exception(errors[k]);
     }
   }
 
-  return image_shades;
+  // join the labels in file order, deduplicated like a single thread would
+  for (const ClassIndex &labels : chunk_labels) {
+    for (const size_t &label : labels.GetLabels()) {
+      UpdateAmountOfLabels(label);
+    }
+  }
+}
+
+const char *Data::ParseRecord(const char *cursor, const char *end,
+                              size_t line_number, size_t &label,
+                              uint64_t *image_words) const {
+  const char *line_end =
+      static_cast<const char *>(memchr(cursor, '\n', end - cursor));
+  if (line_end == nullptr) {
+    line_end = end;
+  }
+  if (!ParseLabel(cursor, line_end, label)) {
+    throw std::invalid_argument("line " + std::to_string(line_number) +
+                                ": invalid label");
+  }
+  cursor = line_end + (line_end < end);
+
+  size_t words_per_row = Image::WordsPerRow(image_size_);
+  for (size_t i = 0; i < image_size_; i++) {
+    if (cursor >= end) {
+      throw std::invalid_argument(
+          "line " + std::to_string(line_number) + ": record has " +
+          std::to_string(i) + " of " + std::to_string(image_size_) + " rows");
+    }
+    line_end = static_cast<const char *>(memchr(cursor, '\n', end - cursor));
+    if (line_end == nullptr) {
+      line_end = end;
+    }
+    PackRow(cursor, line_end, image_words + i * words_per_row);
+    cursor = line_end + (line_end < end);
+  }
+  return cursor;
+}
+
+bool Data::ParseLabel(const char *line, const char *line_end, size_t &label) {
+  while (line < line_end && (*line == ' ' || *line == '\t')) {
+    line++;
+  }
+  if (line < line_end && *line == '+') {
+    line++;
+  }
+  if (line == line_end || *line < '0' || *line > '9') {
+    return false;
+  }
+  label = 0;
+  while (line < line_end && *line >= '0' && *line <= '9') {
+    label = label * 10 + (*line - '0');
+    line++;
+  }
+  return true;
+}
+
+void Data::UpdateAmountOfLabels(size_t label) {
+  labels_.Insert(label);
+}
+
+void Data::AddImage(size_t label, const vector<vector<size_t>> &pixels) {
+  if (pixels.size() != image_size_) {
+    throw std::invalid_argument("image has " + std::to_string(pixels.size()) +
+                                " of " + std::to_string(image_size_) +
+                                " rows");
+  }
+  for (const vector<size_t> &row : pixels) {
+    if (row.size() != image_size_) {
+      throw std::invalid_argument("image row has " +
+                                  std::to_string(row.size()) + " of " +
+                                  std::to_string(image_size_) + " pixels");
+    }
+  }
+  UpdateAmountOfLabels(label);
+  Image::Pack(pixels, image_size_, AppendImage(label));
+}
+
+uint64_t *Data::AppendImage(size_t label) {
+  image_labels_.push_back(label);
+  image_words_.resize(image_words_.size() + words_per_image_, 0);
+  return &image_words_[image_words_.size() - words_per_image_];
+}
+
+void Data::PackRow(const char *row, const char *row_end,
+                   uint64_t *row_words) const {
+  size_t length = std::min<size_t>(row_end - row, image_size_);
+  for (size_t j = 0; j < length; j++) {
+    uint64_t shade = shade_table_[(unsigned char)row[j]];
+    row_words[j / Image::kBitsPerWord] |= shade << (j % Image::kBitsPerWord);
+  }
 }
 
 // Getters
-const vector<Image> &Data::GetImages() const { return images_; }
+ImageList Data::GetImages() const {
+  return ImageList(image_words_.data(), image_labels_.data(),
+                   image_labels_.size(), image_size_);
+}
 
-const vector<size_t> &Data::GetLabels() const { return labels_; }
+const vector<size_t> &Data::GetLabels() const { return labels_.GetLabels(); }
 
 size_t Data::GetImageSize() const { return image_size_; }
 
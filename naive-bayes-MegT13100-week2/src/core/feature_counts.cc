@@ -0,0 +1,180 @@
+#include <core/bit_operations.h>
+#include <core/feature_counts.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace naivebayes {
+
+const size_t FeatureCounts::kBitSliceWidth;
+
+FeatureCounts::FeatureCounts(size_t number_of_classes, size_t number_of_pixels)
+    : number_of_pixels_(number_of_pixels), total_count_(0),
+      class_counts_(number_of_classes, 0),
+      shaded_counts_(number_of_classes * number_of_pixels, 0) {}
+
+FeatureCounts::FeatureCounts(size_t number_of_classes, size_t number_of_pixels,
+                             const uint32_t *class_counts,
+                             const uint32_t *shaded_counts)
+    : number_of_pixels_(number_of_pixels), total_count_(0),
+      class_counts_(class_counts, class_counts + number_of_classes),
+      shaded_counts_(shaded_counts,
+                     shaded_counts + number_of_classes * number_of_pixels) {
+  for (const uint32_t &count : class_counts_) {
+    total_count_ += count;
+  }
+}
+
+void FeatureCounts::AddImage(size_t class_index, const Image &image) {
+  class_counts_[class_index]++;
+  total_count_++;
+
+  uint32_t *shaded_counts = &shaded_counts_[class_index * number_of_pixels_];
+  size_t words_per_row = image.GetWordsPerRow();
+  for (size_t i = 0; i < image.GetImageSize(); i++) {
+    uint32_t *row_counts = shaded_counts + i * image.GetImageSize();
+    for (size_t w = 0; w < words_per_row; w++) {
+      uint64_t word = image.GetWords()[i * words_per_row + w];
+      while (word != 0) {
+        row_counts[w * Image::kBitsPerWord + CountTrailingZeros(word)]++;
+        word &= word - 1;
+      }
+    }
+  }
+}
+
+void FeatureCounts::RemoveImage(size_t class_index, const Image &image) {
+  if (class_counts_[class_index] == 0) {
+    throw std::invalid_argument("class has no images to remove");
+  }
+
+  // check every count first so a bad image leaves the counts untouched
+  uint32_t *shaded_counts = &shaded_counts_[class_index * number_of_pixels_];
+  vector<size_t> shaded_pixels;
+  image.GetShadedPixels(shaded_pixels);
+  for (const size_t &pixel : shaded_pixels) {
+    if (shaded_counts[pixel] == 0) {
+      throw std::invalid_argument("image was not counted for this class");
+    }
+  }
+
+  class_counts_[class_index]--;
+  total_count_--;
+  for (const size_t &pixel : shaded_pixels) {
+    shaded_counts[pixel]--;
+  }
+}
+
+void FeatureCounts::AppendClass() {
+  class_counts_.push_back(0);
+  shaded_counts_.resize(shaded_counts_.size() + number_of_pixels_, 0);
+}
+
+void FeatureCounts::ReorderClasses(const vector<size_t> &order) {
+  vector<uint32_t> class_counts(class_counts_.size());
+  vector<uint32_t> shaded_counts(shaded_counts_.size());
+  for (size_t c = 0; c < order.size(); c++) {
+    class_counts[c] = class_counts_[order[c]];
+    std::copy(shaded_counts_.begin() + order[c] * number_of_pixels_,
+              shaded_counts_.begin() + (order[c] + 1) * number_of_pixels_,
+              shaded_counts.begin() + c * number_of_pixels_);
+  }
+  class_counts_.swap(class_counts);
+  shaded_counts_.swap(shaded_counts);
+}
+
+void FeatureCounts::AddImageBlock(const uint64_t *images, size_t image_size,
+                                  const size_t *class_indices, size_t count) {
+  if (count > kBitSliceWidth) {
+    throw std::invalid_argument("image block is larger than 64 images");
+  }
+
+  // one mask of images per class present in the block
+  size_t block_classes[kBitSliceWidth];
+  uint64_t class_masks[kBitSliceWidth];
+  size_t number_of_block_classes = 0;
+  for (size_t b = 0; b < count; b++) {
+    size_t q = 0;
+    while (q < number_of_block_classes && block_classes[q] != class_indices[b]) {
+      q++;
+    }
+    if (q == number_of_block_classes) {
+      block_classes[q] = class_indices[b];
+      class_masks[q] = 0;
+      number_of_block_classes++;
+    }
+    class_masks[q] |= uint64_t(1) << b;
+  }
+  for (size_t q = 0; q < number_of_block_classes; q++) {
+    class_counts_[block_classes[q]] += PopCount(class_masks[q]);
+  }
+  total_count_ += count;
+
+  size_t words_per_row = Image::WordsPerRow(image_size);
+  size_t words_per_image = image_size * words_per_row;
+  uint64_t slices[kBitSliceWidth];
+  for (size_t i = 0; i < image_size; i++) {
+    for (size_t w = 0; w < words_per_row; w++) {
+      for (size_t b = 0; b < kBitSliceWidth; b++) {
+        slices[b] =
+            b < count ? images[b * words_per_image + i * words_per_row + w] : 0;
+      }
+      TransposeBitMatrix64(slices);
+
+      size_t first_column = w * Image::kBitsPerWord;
+      size_t columns = std::min<size_t>(Image::kBitsPerWord,
+                                        image_size - first_column);
+      for (size_t k = 0; k < columns; k++) {
+        if (slices[k] == 0) {
+          continue;
+        }
+        size_t pixel = i * image_size + first_column + k;
+        for (size_t q = 0; q < number_of_block_classes; q++) {
+          shaded_counts_[block_classes[q] * number_of_pixels_ + pixel] +=
+              PopCount(slices[k] & class_masks[q]);
+        }
+      }
+    }
+  }
+}
+
+void FeatureCounts::Merge(const FeatureCounts &other) {
+  if (other.class_counts_.size() != class_counts_.size() ||
+      other.number_of_pixels_ != number_of_pixels_) {
+    throw std::invalid_argument("feature counts have different dimensions");
+  }
+  for (size_t c = 0; c < class_counts_.size(); c++) {
+    class_counts_[c] += other.class_counts_[c];
+  }
+  total_count_ += other.total_count_;
+  for (size_t i = 0; i < shaded_counts_.size(); i++) {
+    shaded_counts_[i] += other.shaded_counts_[i];
+  }
+}
+
+// Getters
+uint32_t FeatureCounts::GetClassCount(size_t class_index) const {
+  return class_counts_[class_index];
+}
+
+uint64_t FeatureCounts::GetTotalCount() const { return total_count_; }
+
+uint32_t FeatureCounts::GetShadedCount(size_t class_index,
+                                       size_t pixel) const {
+  return shaded_counts_[class_index * number_of_pixels_ + pixel];
+}
+
+size_t FeatureCounts::GetNumberOfClasses() const {
+  return class_counts_.size();
+}
+
+size_t FeatureCounts::GetNumberOfPixels() const { return number_of_pixels_; }
+
+const uint32_t *FeatureCounts::GetClassCounts() const {
+  return class_counts_.data();
+}
+
+const uint32_t *FeatureCounts::GetShadedCounts() const {
+  return shaded_counts_.data();
+}
+
+}
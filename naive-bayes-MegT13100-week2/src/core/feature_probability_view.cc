@@ -0,0 +1,71 @@
+#include <core/feature_probability_view.h>
+
+namespace naivebayes {
+
+FeatureProbabilityView::FeatureProbabilityView(
+    const double *table, const ClassIndex &class_index, size_t image_size,
+    size_t number_of_shades)
+    : table_(table), class_index_(&class_index), image_size_(image_size),
+      number_of_shades_(number_of_shades) {}
+
+FeatureProbabilityView::RowView FeatureProbabilityView::operator[](
+    size_t row) const {
+  return RowView(*this, row);
+}
+
+size_t FeatureProbabilityView::size() const { return image_size_; }
+
+double FeatureProbabilityView::Get(size_t label, size_t pixel,
+                                   size_t shade) const {
+  size_t class_index = class_index_->At(label);
+  size_t number_of_pixels = image_size_ * image_size_;
+  return table_[(class_index * number_of_pixels + pixel) * number_of_shades_ +
+                shade];
+}
+
+// RowView
+FeatureProbabilityView::RowView::RowView(const FeatureProbabilityView &view,
+                                         size_t row)
+    : view_(view), row_(row) {}
+
+FeatureProbabilityView::PixelView FeatureProbabilityView::RowView::operator[](
+    size_t column) const {
+  return PixelView(view_, row_ * view_.image_size_ + column);
+}
+
+size_t FeatureProbabilityView::RowView::size() const {
+  return view_.image_size_;
+}
+
+// PixelView
+FeatureProbabilityView::PixelView::PixelView(
+    const FeatureProbabilityView &view, size_t pixel)
+    : view_(view), pixel_(pixel) {}
+
+FeatureProbabilityView::ShadeView FeatureProbabilityView::PixelView::operator[](
+    size_t shade) const {
+  return ShadeView(view_, pixel_, shade);
+}
+
+size_t FeatureProbabilityView::PixelView::size() const {
+  return view_.number_of_shades_;
+}
+
+// ShadeView
+FeatureProbabilityView::ShadeView::ShadeView(
+    const FeatureProbabilityView &view, size_t pixel, size_t shade)
+    : view_(view), pixel_(pixel), shade_(shade) {}
+
+double FeatureProbabilityView::ShadeView::operator[](size_t label) const {
+  return view_.Get(label, pixel_, shade_);
+}
+
+double FeatureProbabilityView::ShadeView::at(size_t label) const {
+  return view_.Get(label, pixel_, shade_);
+}
+
+size_t FeatureProbabilityView::ShadeView::size() const {
+  return view_.class_index_->size();
+}
+
+}
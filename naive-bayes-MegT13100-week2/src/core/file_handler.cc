@@ -1,7 +1,35 @@
 #include "core/file_handler.h"
+#include "core/mapped_file.h"
+
+#include <cstring>
+#include <stdexcept>
 
 namespace naivebayes {
 
+namespace {
+
+/**
+ * Rejects a file without the minimum structure of a data set: a label line
+ * and at least one more line. Only the bytes up to the second line are
+ * looked at.
+ *
+ * @param file mapped file
+ * @throws std::invalid_argument if the file has fewer than two lines
+ */
+void CheckHasTwoLines(const MappedFile &file) {
+  if (file.IsEmpty()) {
+    throw std::invalid_argument("file is empty");
+  }
+  const char *end = file.GetData() + file.GetSize();
+  const char *line_break = static_cast<const char *>(
+      memchr(file.GetData(), '\n', file.GetSize()));
+  if (line_break == nullptr || line_break + 1 == end) {
+    throw std::invalid_argument("file is empty");
+  }
+}
+
+}
+
 /**
  * FileHandler constructor.
  * @param file_path path of the file
@@ -18,39 +46,30 @@ Data FileHandler::GetData() {return data_;}
  * Handles reading the file.
  */
 void FileHandler::HandleFile() {
-  if (IsFileValid(file_path_)) {
-    throw std::exception();
+  if (file_path_.empty()) {
+    throw std::invalid_argument("empty file_path");
   }
 
-  std::ifstream if_(file_path_);
-  if_ >> data_;
+  MappedFile file(file_path_);
+  CheckHasTwoLines(file);
+  data_.ParseBuffer(file.GetData(), file.GetData() + file.GetSize());
 }
 
 /**
  * Determines of the file is valid.
  * @param file_path path of the file
- * @return true if the file is valid, false otherwise
+ * @return true if the file is valid
  */
 bool FileHandler::IsFileValid(std::string file_path) {
-  // test if actual file is empty
-  int number_of_lines = 0;
-  std::string line;
-  std::ifstream my_file(file_path);
-
-  while (std::getline(my_file, line)) ++number_of_lines;
-
-  if (number_of_lines <= 1) {
-    throw std::invalid_argument("file is empty");
-  }
-
   // tests if path is empty
   if (file_path.empty()) {
     throw std::invalid_argument("empty file_path");
   }
 
-  // other tests
-  std::ifstream pFile(file_path);
-  return pFile.peek() == std::ifstream::traits_type::eof();
+  // only the first line and the start of the second are read
+  MappedFile file(file_path);
+  CheckHasTwoLines(file);
+  return true;
 }
 
-}
\ No newline at end of file
+}
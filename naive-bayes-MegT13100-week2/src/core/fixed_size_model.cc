@@ -0,0 +1,111 @@
+#include <core/bit_operations.h>
+#include <core/fixed_size_model.h>
+#include <array>
+#include <limits>
+#include <stdexcept>
+
+namespace naivebayes {
+
+template <size_t kImageSize, size_t kLaneCount>
+FixedSizeModel<kImageSize, kLaneCount>::FixedSizeModel(
+    const ScoringTables &tables)
+    : weights_(tables.GetInterleavedWeights()),
+      biases_(tables.GetClassBiases()), labels_(tables.GetLabels()),
+      number_of_classes_(tables.GetNumberOfClasses()) {
+  if (tables.GetImageSize() != kImageSize ||
+      tables.GetLaneCount() != kLaneCount) {
+    throw std::invalid_argument("scoring tables do not fit the model");
+  }
+}
+
+template <size_t kImageSize, size_t kLaneCount>
+int FixedSizeModel<kImageSize, kLaneCount>::Classify(
+    const uint64_t *image_words) const {
+  std::array<float, kLaneCount> scores;
+  for (size_t lane = 0; lane < kLaneCount; lane++) {
+    scores[lane] = biases_[lane];
+  }
+  for (size_t row = 0; row < kImageSize; row++) {
+    for (size_t w = 0; w < kWordsPerRow; w++) {
+      uint64_t word = image_words[row * kWordsPerRow + w];
+      while (word != 0) {
+        size_t pixel = row * kImageSize + w * Image::kBitsPerWord +
+                       CountTrailingZeros(word);
+        word &= word - 1;
+        const float *weights = weights_ + pixel * kLaneCount;
+        for (size_t lane = 0; lane < kLaneCount; lane++) {
+          scores[lane] += weights[lane];
+        }
+      }
+    }
+  }
+
+  // the first class with the highest score, like ScoringTables; the padding
+  // lanes are not classes
+  float highest_likelihood = -std::numeric_limits<float>::max();
+  int most_likely = -1;
+  for (size_t c = 0; c < number_of_classes_; c++) {
+    if (scores[c] > highest_likelihood) {
+      highest_likelihood = scores[c];
+      most_likely = (int)labels_[c];
+    }
+  }
+  return most_likely;
+}
+
+template <size_t kImageSize, size_t kLaneCount>
+size_t FixedSizeModel<kImageSize, kLaneCount>::GetImageSize() const {
+  return kImageSize;
+}
+
+template class FixedSizeModel<3, 8>;
+template class FixedSizeModel<3, 16>;
+template class FixedSizeModel<5, 8>;
+template class FixedSizeModel<5, 16>;
+template class FixedSizeModel<28, 8>;
+template class FixedSizeModel<28, 16>;
+
+namespace {
+
+/**
+ * Picks the specialization for the lane count of tables of one image size.
+ *
+ * @param tables tables of kImageSize images
+ * @return the specialized model, or null if there are too many classes
+ */
+template <size_t kImageSize>
+std::unique_ptr<const SpecializedModel> MakeForLaneCount(
+    const ScoringTables &tables) {
+  switch (tables.GetLaneCount()) {
+    case 8:
+      return std::unique_ptr<const SpecializedModel>(
+          new FixedSizeModel<kImageSize, 8>(tables));
+    case 16:
+      return std::unique_ptr<const SpecializedModel>(
+          new FixedSizeModel<kImageSize, 16>(tables));
+    default:
+      return nullptr;
+  }
+}
+
+}
+
+std::unique_ptr<const SpecializedModel> MakeFixedSizeModel(
+    const ScoringTables &tables) {
+  if (tables.GetNumberOfClasses() == 0 ||
+      tables.GetNumberOfClasses() > kSpecializedLaneCount) {
+    return nullptr;
+  }
+  switch (tables.GetImageSize()) {
+    case 3:
+      return MakeForLaneCount<3>(tables);
+    case 5:
+      return MakeForLaneCount<5>(tables);
+    case 28:
+      return MakeForLaneCount<28>(tables);
+    default:
+      return nullptr;
+  }
+}
+
+}
@@ -1,18 +1,85 @@
 #include "core/image.h"
+#include "core/bit_operations.h"
 using std::vector;
 using naivebayes::Pixel;
 
 namespace naivebayes {
 
-Image::Image(size_t label, size_t image_size, vector<vector<size_t>> &image)
-    : label_(label), image_size_(image_size), image_(std::move(image)){}
+const size_t Image::kBitsPerWord;
+
+Image::Image(size_t label, size_t image_size, const uint64_t *words)
+    : label_(label), image_size_(image_size), words_(words) {}
+
+size_t Image::WordsPerRow(size_t image_size) {
+  return (image_size + kBitsPerWord - 1) / kBitsPerWord;
+}
+
+void Image::Pack(const vector<vector<size_t>> &pixels, size_t image_size,
+                 uint64_t *words) {
+  size_t words_per_row = WordsPerRow(image_size);
+  for (size_t i = 0; i < image_size; i++) {
+    uint64_t *row = words + i * words_per_row;
+    for (size_t w = 0; w < words_per_row; w++) {
+      row[w] = 0;
+    }
+    for (size_t j = 0; j < image_size; j++) {
+      if (pixels[i][j] == kShadedPixel) {
+        row[j / kBitsPerWord] |= uint64_t(1) << (j % kBitsPerWord);
+      }
+    }
+  }
+}
+
+void Image::FindShadedPixels(const vector<vector<size_t>> &pixels,
+                             vector<size_t> &shaded_pixels) {
+  shaded_pixels.clear();
+  for (size_t i = 0; i < pixels.size(); i++) {
+    for (size_t j = 0; j < pixels[i].size(); j++) {
+      if (pixels[i][j] == kShadedPixel) {
+        shaded_pixels.push_back(i * pixels.size() + j);
+      }
+    }
+  }
+}
+
+void Image::GetShadedPixels(vector<size_t> &shaded_pixels) const {
+  shaded_pixels.clear();
+  size_t words_per_row = GetWordsPerRow();
+  for (size_t i = 0; i < image_size_; i++) {
+    for (size_t w = 0; w < words_per_row; w++) {
+      uint64_t word = words_[i * words_per_row + w];
+      while (word != 0) {
+        shaded_pixels.push_back(i * image_size_ + w * kBitsPerWord +
+                                CountTrailingZeros(word));
+        word &= word - 1;
+      }
+    }
+  }
+}
+
+size_t Image::GetPixel(size_t row, size_t column) const {
+  uint64_t word = words_[row * GetWordsPerRow() + column / kBitsPerWord];
+  return (word >> (column % kBitsPerWord)) & 1;
+}
 
 // Getters
 const size_t &Image::GetLabel() const {return label_;}
 
 const size_t &Image::GetImageSize() const {return image_size_;}
 
-const vector<vector<size_t>> &Image::GetImage() const {return image_;}
+const uint64_t *Image::GetWords() const {return words_;}
+
+size_t Image::GetWordsPerRow() const {return WordsPerRow(image_size_);}
+
+vector<vector<size_t>> Image::GetImage() const {
+  vector<vector<size_t>> pixels(image_size_, vector<size_t>(image_size_));
+  for (size_t i = 0; i < image_size_; i++) {
+    for (size_t j = 0; j < image_size_; j++) {
+      pixels[i][j] = GetPixel(i, j);
+    }
+  }
+  return pixels;
+}
 
 
 } // namespace naivebayes
@@ -0,0 +1,62 @@
+#include <core/image_list.h>
+#include <stdexcept>
+
+namespace naivebayes {
+
+ImageList::ImageList(const uint64_t *words, const size_t *labels, size_t count,
+                     size_t image_size)
+    : words_(words), labels_(labels), count_(count), image_size_(image_size),
+      words_per_image_(image_size * Image::WordsPerRow(image_size)) {}
+
+Image ImageList::operator[](size_t index) const {
+  return Image(labels_[index], image_size_,
+               words_ + index * words_per_image_);
+}
+
+Image ImageList::at(size_t index) const {
+  if (index >= count_) {
+    throw std::out_of_range("image index out of range");
+  }
+  return (*this)[index];
+}
+
+size_t ImageList::size() const { return count_; }
+
+bool ImageList::empty() const { return count_ == 0; }
+
+ImageList::const_iterator ImageList::begin() const {
+  return const_iterator(this, 0);
+}
+
+ImageList::const_iterator ImageList::end() const {
+  return const_iterator(this, count_);
+}
+
+// const_iterator
+ImageList::const_iterator::const_iterator(const ImageList *list, size_t index)
+    : list_(list), index_(index) {}
+
+Image ImageList::const_iterator::operator*() const {
+  return (*list_)[index_];
+}
+
+ImageList::const_iterator &ImageList::const_iterator::operator++() {
+  ++index_;
+  return *this;
+}
+
+ImageList::const_iterator ImageList::const_iterator::operator++(int) {
+  const_iterator previous = *this;
+  ++index_;
+  return previous;
+}
+
+bool ImageList::const_iterator::operator==(const const_iterator &other) const {
+  return index_ == other.index_;
+}
+
+bool ImageList::const_iterator::operator!=(const const_iterator &other) const {
+  return index_ != other.index_;
+}
+
+}
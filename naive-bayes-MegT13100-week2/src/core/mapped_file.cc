@@ -0,0 +1,142 @@
+#include <core/mapped_file.h>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace naivebayes {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &file_path)
+    : data_(nullptr), size_(0), mapping_handle_(nullptr) {
+  HANDLE file = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw std::invalid_argument("cannot open " + file_path);
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    throw std::invalid_argument("cannot read the size of " + file_path);
+  }
+  size_ = (size_t)size.QuadPart;
+  if (size_ > 0) {
+    mapping_handle_ =
+        CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_handle_ != nullptr) {
+      data_ = static_cast<const char *>(
+          MapViewOfFile(mapping_handle_, FILE_MAP_READ, 0, 0, 0));
+    }
+  }
+  CloseHandle(file);
+  if (size_ > 0 && data_ == nullptr) {
+    Release();
+    throw std::invalid_argument("cannot map " + file_path);
+  }
+}
+
+void MappedFile::Release() {
+  if (data_ != nullptr) {
+    UnmapViewOfFile(data_);
+  }
+  if (mapping_handle_ != nullptr) {
+    CloseHandle(mapping_handle_);
+  }
+  data_ = nullptr;
+  mapping_handle_ = nullptr;
+  size_ = 0;
+}
+
+MappedFile::MappedFile(MappedFile &&other)
+    : data_(other.data_), size_(other.size_),
+      mapping_handle_(other.mapping_handle_) {
+  other.data_ = nullptr;
+  other.size_ = 0;
+  other.mapping_handle_ = nullptr;
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) {
+  if (this != &other) {
+    Release();
+    data_ = other.data_;
+    size_ = other.size_;
+    mapping_handle_ = other.mapping_handle_;
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.mapping_handle_ = nullptr;
+  }
+  return *this;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &file_path)
+    : data_(nullptr), size_(0) {
+  int file = open(file_path.c_str(), O_RDONLY);
+  if (file < 0) {
+    throw std::invalid_argument("cannot open " + file_path);
+  }
+  struct stat status;
+  if (fstat(file, &status) != 0 || !S_ISREG(status.st_mode)) {
+    close(file);
+    throw std::invalid_argument("not a regular file: " + file_path);
+  }
+  size_ = (size_t)status.st_size;
+  if (size_ > 0) {
+    void *mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file, 0);
+    if (mapping == MAP_FAILED) {
+      close(file);
+      size_ = 0;
+      throw std::invalid_argument("cannot map " + file_path);
+    }
+    madvise(mapping, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const char *>(mapping);
+  }
+  close(file);
+}
+
+void MappedFile::Release() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char *>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+}
+
+MappedFile::MappedFile(MappedFile &&other)
+    : data_(other.data_), size_(other.size_) {
+  other.data_ = nullptr;
+  other.size_ = 0;
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) {
+  if (this != &other) {
+    Release();
+    data_ = other.data_;
+    size_ = other.size_;
+    other.data_ = nullptr;
+    other.size_ = 0;
+  }
+  return *this;
+}
+
+#endif
+
+MappedFile::~MappedFile() { Release(); }
+
+// Getters
+const char *MappedFile::GetData() const { return data_; }
+
+size_t MappedFile::GetSize() const { return size_; }
+
+bool MappedFile::IsEmpty() const { return size_ == 0; }
+
+}
@@ -0,0 +1,207 @@
+#include <core/model_file.h>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace naivebayes {
+
+const uint32_t ModelFile::kMagic;
+const uint32_t ModelFile::kSwappedMagic;
+const uint32_t ModelFile::kVersion;
+const uint32_t ModelFile::kHasCounts;
+const size_t ModelFile::kSectionAlignment;
+
+namespace {
+
+// FNV-1a parameters, applied to 64-bit words instead of bytes
+const uint64_t kChecksumBasis = 14695981039346656037ULL;
+const uint64_t kChecksumPrime = 1099511628211ULL;
+
+size_t AlignSection(size_t offset) {
+  return (offset + ModelFile::kSectionAlignment - 1) /
+         ModelFile::kSectionAlignment * ModelFile::kSectionAlignment;
+}
+
+}
+
+ModelFile::ModelFile(const std::string &file_path) : file_(file_path) {
+  if (file_.GetSize() < sizeof(ModelFileHeader)) {
+    throw std::invalid_argument("model file is too small: " + file_path);
+  }
+
+  const ModelFileHeader &header = GetHeader();
+  if (header.magic == kSwappedMagic) {
+    throw std::invalid_argument("model file was written with the other byte "
+                                "order: " + file_path);
+  }
+  if (header.magic != kMagic) {
+    throw std::invalid_argument("not a model file: " + file_path);
+  }
+  if (header.version != kVersion) {
+    throw std::invalid_argument("unsupported model file version " +
+                                std::to_string(header.version) + ": " +
+                                file_path);
+  }
+
+  ComputeOffsets(header, offsets_);
+  if (header.file_size != file_.GetSize() ||
+      offsets_[kNumberOfSections] != file_.GetSize()) {
+    throw std::invalid_argument("truncated model file: " + file_path);
+  }
+
+  const char *payload = file_.GetData() + offsets_[0];
+  if (Checksum(payload, file_.GetSize() - offsets_[0]) != header.checksum) {
+    throw std::invalid_argument("model file checksum mismatch: " + file_path);
+  }
+}
+
+void ModelFile::Write(const std::string &file_path,
+                      const ModelFileSections &sections) {
+  ModelFileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.image_size = (uint32_t)sections.image_size;
+  header.number_of_shades = (uint32_t)sections.number_of_shades;
+  header.number_of_classes = (uint32_t)sections.number_of_classes;
+  header.lane_count = (uint32_t)sections.lane_count;
+  if (sections.class_counts != nullptr && sections.shaded_counts != nullptr) {
+    header.flags |= kHasCounts;
+  }
+
+  size_t offsets[kNumberOfSections + 1];
+  ComputeOffsets(header, offsets);
+  header.file_size = offsets[kNumberOfSections];
+
+  const void *contents[kNumberOfSections] = {
+      sections.labels,
+      sections.priors,
+      sections.log_priors,
+      sections.feature_probabilities,
+      sections.unshaded_baselines,
+      sections.shaded_deltas,
+      sections.interleaved_weights,
+      sections.class_biases,
+      sections.class_counts,
+      sections.shaded_counts};
+
+  size_t sizes[kNumberOfSections];
+  ComputeSectionSizes(header, sizes);
+
+  // uint64_t storage keeps the buffer 8-byte aligned for Checksum(); the
+  // padding between sections stays zero
+  std::vector<uint64_t> buffer(header.file_size / sizeof(uint64_t), 0);
+  char *bytes = reinterpret_cast<char *>(buffer.data());
+  for (size_t s = 0; s < kNumberOfSections; s++) {
+    if (contents[s] != nullptr && sizes[s] != 0) {
+      std::memcpy(bytes + offsets[s], contents[s], sizes[s]);
+    }
+  }
+
+  header.checksum =
+      Checksum(bytes + offsets[0], header.file_size - offsets[0]);
+  std::memcpy(bytes, &header, sizeof(header));
+
+  std::ofstream file(file_path, std::ios::binary | std::ios::trunc);
+  if (!file.write(bytes, header.file_size)) {
+    throw std::invalid_argument("could not write model file: " + file_path);
+  }
+}
+
+bool ModelFile::IsModelFile(const std::string &file_path) {
+  std::ifstream file(file_path, std::ios::binary);
+  uint32_t magic = 0;
+  return file.read(reinterpret_cast<char *>(&magic), sizeof(magic)) &&
+         magic == kMagic;
+}
+
+const ModelFileHeader &ModelFile::GetHeader() const {
+  return *reinterpret_cast<const ModelFileHeader *>(file_.GetData());
+}
+
+bool ModelFile::HasCounts() const {
+  return (GetHeader().flags & kHasCounts) != 0;
+}
+
+ModelFileSections ModelFile::GetSections() const {
+  const ModelFileHeader &header = GetHeader();
+  ModelFileSections sections;
+  sections.image_size = header.image_size;
+  sections.number_of_shades = header.number_of_shades;
+  sections.number_of_classes = header.number_of_classes;
+  sections.lane_count = header.lane_count;
+
+  sections.labels = reinterpret_cast<const uint64_t *>(SectionData(kLabels));
+  sections.priors = reinterpret_cast<const double *>(SectionData(kPriors));
+  sections.log_priors =
+      reinterpret_cast<const double *>(SectionData(kLogPriors));
+  sections.feature_probabilities =
+      reinterpret_cast<const double *>(SectionData(kFeatureProbabilities));
+  sections.unshaded_baselines =
+      reinterpret_cast<const double *>(SectionData(kUnshadedBaselines));
+  sections.shaded_deltas =
+      reinterpret_cast<const double *>(SectionData(kShadedDeltas));
+  sections.interleaved_weights =
+      reinterpret_cast<const float *>(SectionData(kInterleavedWeights));
+  sections.class_biases =
+      reinterpret_cast<const float *>(SectionData(kClassBiases));
+  sections.class_counts = nullptr;
+  sections.shaded_counts = nullptr;
+  if (HasCounts()) {
+    sections.class_counts =
+        reinterpret_cast<const uint32_t *>(SectionData(kClassCounts));
+    sections.shaded_counts =
+        reinterpret_cast<const uint32_t *>(SectionData(kShadedCounts));
+  }
+  return sections;
+}
+
+void ModelFile::ComputeSectionSizes(const ModelFileHeader &header,
+                                    size_t *sizes) {
+  size_t classes = header.number_of_classes;
+  size_t number_of_pixels = (size_t)header.image_size * header.image_size;
+  bool has_counts = (header.flags & kHasCounts) != 0;
+
+  sizes[kLabels] = classes * sizeof(uint64_t);
+  sizes[kPriors] = classes * sizeof(double);
+  sizes[kLogPriors] = classes * sizeof(double);
+  sizes[kFeatureProbabilities] =
+      classes * number_of_pixels * header.number_of_shades * sizeof(double);
+  sizes[kUnshadedBaselines] = classes * sizeof(double);
+  sizes[kShadedDeltas] = classes * number_of_pixels * sizeof(double);
+  sizes[kInterleavedWeights] =
+      number_of_pixels * header.lane_count * sizeof(float);
+  sizes[kClassBiases] = header.lane_count * sizeof(float);
+  sizes[kClassCounts] = has_counts ? classes * sizeof(uint32_t) : 0;
+  sizes[kShadedCounts] =
+      has_counts ? classes * number_of_pixels * sizeof(uint32_t) : 0;
+}
+
+void ModelFile::ComputeOffsets(const ModelFileHeader &header,
+                               size_t *offsets) {
+  size_t sizes[kNumberOfSections];
+  ComputeSectionSizes(header, sizes);
+
+  size_t offset = AlignSection(sizeof(ModelFileHeader));
+  for (size_t s = 0; s < kNumberOfSections; s++) {
+    offsets[s] = offset;
+    offset = AlignSection(offset + sizes[s]);
+  }
+  offsets[kNumberOfSections] = offset;
+}
+
+uint64_t ModelFile::Checksum(const char *begin, size_t size) {
+  const uint64_t *words = reinterpret_cast<const uint64_t *>(begin);
+  uint64_t hash = kChecksumBasis;
+  for (size_t i = 0; i < size / sizeof(uint64_t); i++) {
+    hash = (hash ^ words[i]) * kChecksumPrime;
+  }
+  return hash;
+}
+
+const char *ModelFile::SectionData(Section section) const {
+  return file_.GetData() + offsets_[section];
+}
+
+}
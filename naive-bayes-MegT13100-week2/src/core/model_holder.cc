@@ -0,0 +1,131 @@
+#include <core/model_file.h>
+#include <core/model_holder.h>
+#include <core/trace.h>
+#include <core/training_model.h>
+#include <stdexcept>
+
+namespace naivebayes {
+
+ModelHolder::Snapshot::Snapshot(std::atomic<size_t> *readers,
+                                const Classifier *classifier)
+    : readers_(readers), classifier_(classifier) {}
+
+ModelHolder::Snapshot::Snapshot(Snapshot &&other)
+    : readers_(other.readers_), classifier_(other.classifier_) {
+  other.readers_ = nullptr;
+}
+
+ModelHolder::Snapshot::~Snapshot() {
+  if (readers_ != nullptr) {
+    readers_->fetch_sub(1);
+  }
+}
+
+const Classifier &ModelHolder::Snapshot::operator*() const {
+  return *classifier_;
+}
+
+const Classifier *ModelHolder::Snapshot::operator->() const {
+  return classifier_;
+}
+
+ModelHolder::ModelHolder(std::unique_ptr<const Classifier> classifier)
+    : current_(classifier.release()), version_(1), epoch_(0) {
+  readers_[0].count = 0;
+  readers_[1].count = 0;
+}
+
+ModelHolder::ModelHolder(const std::string &file_path, size_t image_size)
+    : ModelHolder(LoadClassifier(file_path, image_size)) {}
+
+ModelHolder::~ModelHolder() {
+  {
+    std::lock_guard<std::mutex> lock(load_mutex_);
+    if (loader_.joinable()) {
+      loader_.join();
+    }
+  }
+  delete current_.load();
+}
+
+ModelHolder::Snapshot ModelHolder::Acquire() const {
+  // mark this reader before loading the pointer, so that a publisher that
+  // swaps the pointer afterwards is sure to wait for it
+  std::atomic<size_t> *readers = &readers_[epoch_.load() % 2].count;
+  readers->fetch_add(1);
+  return Snapshot(readers, current_.load());
+}
+
+int ModelHolder::Classify(const Image &image) const {
+  return Acquire()->Classify(image);
+}
+
+int ModelHolder::Classify(const vector<vector<size_t>> &pixels) const {
+  return Acquire()->Classify(pixels);
+}
+
+void ModelHolder::Publish(std::unique_ptr<const Classifier> classifier) {
+  NAIVEBAYES_TRACE_SCOPE("load/publish");
+  std::lock_guard<std::mutex> lock(publish_mutex_);
+  const Classifier *old_classifier = current_.exchange(classifier.release());
+  version_.fetch_add(1);
+
+  // a reader that saw the old model marked itself before the swap, in
+  // whichever counter was current then; draining both after the swap waits
+  // for all of them
+  WaitForReaders();
+  WaitForReaders();
+  delete old_classifier;
+}
+
+void ModelHolder::WaitForReaders() {
+  size_t previous_epoch = epoch_.fetch_add(1);
+  std::atomic<size_t> &readers = readers_[previous_epoch % 2].count;
+  while (readers.load() != 0) {
+    std::this_thread::yield();
+  }
+}
+
+void ModelHolder::LoadAsync(const std::string &file_path) {
+  std::lock_guard<std::mutex> lock(load_mutex_);
+  if (loader_.joinable()) {
+    loader_.join();
+  }
+  load_error_ = nullptr;
+  size_t image_size = Acquire()->GetImageSize();
+  loader_ = std::thread([this, file_path, image_size] {
+    try {
+      Publish(LoadClassifier(file_path, image_size));
+    } catch (...) {
+      load_error_ = std::current_exception();
+    }
+  });
+}
+
+void ModelHolder::WaitForLoad() {
+  std::lock_guard<std::mutex> lock(load_mutex_);
+  if (loader_.joinable()) {
+    loader_.join();
+  }
+  if (load_error_) {
+    std::exception_ptr error = load_error_;
+    load_error_ = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+std::unique_ptr<const Classifier> ModelHolder::LoadClassifier(
+    const std::string &file_path, size_t image_size) {
+  NAIVEBAYES_TRACE_SCOPE("load/holder_model");
+  if (ModelFile::IsModelFile(file_path)) {
+    return std::unique_ptr<const Classifier>(new Classifier(file_path));
+  }
+  TrainingModel model(image_size);
+  model.LoadTextModel(file_path);
+  return std::unique_ptr<const Classifier>(new Classifier(model));
+}
+
+// Getters
+size_t ModelHolder::GetVersion() const { return version_.load(); }
+
+}
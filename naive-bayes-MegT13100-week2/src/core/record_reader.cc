@@ -0,0 +1,48 @@
+#include <core/record_reader.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace naivebayes {
+
+RecordReader::RecordReader(std::istream &is, size_t image_size)
+    : is_(is), data_(image_size), label_(0),
+      image_words_(image_size * Image::WordsPerRow(image_size)),
+      line_number_(0), record_count_(0) {}
+
+bool RecordReader::Next() {
+  if (!std::getline(is_, line_)) {
+    return false;
+  }
+  size_t label_line_number = ++line_number_;
+  if (!Data::ParseLabel(line_.data(), line_.data() + line_.size(), label_)) {
+    throw std::invalid_argument("line " + std::to_string(label_line_number) +
+                                ": invalid label");
+  }
+
+  size_t image_size = data_.GetImageSize();
+  size_t words_per_row = Image::WordsPerRow(image_size);
+  std::fill(image_words_.begin(), image_words_.end(), 0);
+  for (size_t i = 0; i < image_size; i++) {
+    if (!std::getline(is_, line_)) {
+      throw std::invalid_argument(
+          "line " + std::to_string(label_line_number) + ": record has " +
+          std::to_string(i) + " of " + std::to_string(image_size) + " rows");
+    }
+    line_number_++;
+    data_.PackRow(line_.data(), line_.data() + line_.size(),
+                  image_words_.data() + i * words_per_row);
+  }
+  record_count_++;
+  return true;
+}
+
+// Getters
+size_t RecordReader::GetLabel() const { return label_; }
+
+Image RecordReader::GetImage() const {
+  return Image(label_, data_.GetImageSize(), image_words_.data());
+}
+
+size_t RecordReader::GetRecordCount() const { return record_count_; }
+
+}
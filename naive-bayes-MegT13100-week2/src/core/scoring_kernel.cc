@@ -0,0 +1,151 @@
+#include <core/scoring_kernel.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define NAIVEBAYES_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang need the instruction set enabled per function, MSVC does not
+#if defined(NAIVEBAYES_X86) && (defined(__GNUC__) || defined(__clang__))
+#define NAIVEBAYES_TARGET_SSE42 __attribute__((target("sse4.2")))
+#define NAIVEBAYES_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define NAIVEBAYES_TARGET_SSE42
+#define NAIVEBAYES_TARGET_AVX2
+#endif
+
+namespace naivebayes {
+
+void AccumulateRowsScalar(const float *weights, size_t stride,
+                          const size_t *rows, size_t row_count,
+                          float *scores) {
+  for (size_t k = 0; k < row_count; k++) {
+    const float *row = weights + rows[k] * stride;
+    for (size_t lane = 0; lane < stride; lane++) {
+      scores[lane] += row[lane];
+    }
+  }
+}
+
+#ifdef NAIVEBAYES_X86
+
+// Keeps 16 lanes in registers per pass over the rows, then 8 for the rest.
+NAIVEBAYES_TARGET_AVX2
+static void AccumulateRowsAvx2(const float *weights, size_t stride,
+                               const size_t *rows, size_t row_count,
+                               float *scores) {
+  size_t lane = 0;
+  for (; lane + 16 <= stride; lane += 16) {
+    __m256 low = _mm256_loadu_ps(scores + lane);
+    __m256 high = _mm256_loadu_ps(scores + lane + 8);
+    for (size_t k = 0; k < row_count; k++) {
+      const float *row = weights + rows[k] * stride + lane;
+      low = _mm256_add_ps(low, _mm256_loadu_ps(row));
+      high = _mm256_add_ps(high, _mm256_loadu_ps(row + 8));
+    }
+    _mm256_storeu_ps(scores + lane, low);
+    _mm256_storeu_ps(scores + lane + 8, high);
+  }
+  for (; lane < stride; lane += 8) {
+    __m256 sum = _mm256_loadu_ps(scores + lane);
+    for (size_t k = 0; k < row_count; k++) {
+      sum = _mm256_add_ps(sum,
+                          _mm256_loadu_ps(weights + rows[k] * stride + lane));
+    }
+    _mm256_storeu_ps(scores + lane, sum);
+  }
+}
+
+// Keeps 8 lanes in registers per pass over the rows.
+NAIVEBAYES_TARGET_SSE42
+static void AccumulateRowsSse42(const float *weights, size_t stride,
+                                const size_t *rows, size_t row_count,
+                                float *scores) {
+  for (size_t lane = 0; lane < stride; lane += 8) {
+    __m128 low = _mm_loadu_ps(scores + lane);
+    __m128 high = _mm_loadu_ps(scores + lane + 4);
+    for (size_t k = 0; k < row_count; k++) {
+      const float *row = weights + rows[k] * stride + lane;
+      low = _mm_add_ps(low, _mm_loadu_ps(row));
+      high = _mm_add_ps(high, _mm_loadu_ps(row + 4));
+    }
+    _mm_storeu_ps(scores + lane, low);
+    _mm_storeu_ps(scores + lane + 4, high);
+  }
+}
+
+static bool CpuSupports(ScoringKernel kernel) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_cpu_init();
+  if (kernel == kAvx2Kernel) {
+    return __builtin_cpu_supports("avx2");
+  }
+  return __builtin_cpu_supports("sse4.2");
+#elif defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  bool sse42 = (info[2] & (1 << 20)) != 0;
+  bool os_saves_ymm = (info[2] & (1 << 27)) != 0 &&
+                      (_xgetbv(0) & 0x6) == 0x6;
+  if (kernel == kSse42Kernel) {
+    return sse42;
+  }
+  __cpuidex(info, 7, 0);
+  return os_saves_ymm && (info[1] & (1 << 5)) != 0;
+#else
+  return false;
+#endif
+}
+
+#endif
+
+bool IsScoringKernelSupported(ScoringKernel kernel) {
+  if (kernel == kScalarKernel) {
+    return true;
+  }
+#ifdef NAIVEBAYES_X86
+  return CpuSupports(kernel);
+#else
+  return false;
+#endif
+}
+
+ScoringKernel GetBestScoringKernel() {
+  if (IsScoringKernelSupported(kAvx2Kernel)) {
+    return kAvx2Kernel;
+  }
+  if (IsScoringKernelSupported(kSse42Kernel)) {
+    return kSse42Kernel;
+  }
+  return kScalarKernel;
+}
+
+AccumulateRowsFunction GetScoringKernel(ScoringKernel kernel) {
+  switch (kernel) {
+#ifdef NAIVEBAYES_X86
+    case kAvx2Kernel:
+      return AccumulateRowsAvx2;
+    case kSse42Kernel:
+      return AccumulateRowsSse42;
+#endif
+    default:
+      return AccumulateRowsScalar;
+  }
+}
+
+void AccumulateRows(const float *weights, size_t stride, const size_t *rows,
+                    size_t row_count, float *scores) {
+  static const AccumulateRowsFunction kBestKernel =
+      GetScoringKernel(GetBestScoringKernel());
+  kBestKernel(weights, stride, rows, row_count, scores);
+}
+
+size_t PaddedLaneCount(size_t number_of_classes) {
+  return (number_of_classes + kScoringLaneWidth - 1) / kScoringLaneWidth *
+         kScoringLaneWidth;
+}
+
+}
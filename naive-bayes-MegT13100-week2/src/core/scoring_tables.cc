@@ -0,0 +1,302 @@
+#include <core/bit_operations.h>
+#include <core/image.h>
+#include <core/scoring_kernel.h>
+#include <core/scoring_tables.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace naivebayes {
+
+const size_t ScoringTables::kBatchBlockSize;
+const size_t ScoringTables::kWeightBlockBytes;
+const size_t ScoringTables::kMaxStackLanes;
+const size_t ScoringTables::kRowBatchSize;
+
+ScoringTables::ScoringTables(size_t image_size, const size_t *labels,
+                             size_t number_of_classes, size_t lane_count,
+                             const float *interleaved_weights,
+                             const float *class_biases)
+    : image_size_(image_size), labels_(labels),
+      number_of_classes_(number_of_classes), lane_count_(lane_count),
+      interleaved_weights_(interleaved_weights), class_biases_(class_biases) {}
+
+int ScoringTables::Classify(const uint64_t *image_words) const {
+  alignas(64) float stack_scores[kMaxStackLanes];
+  vector<float> heap_scores;
+  float *scores = StartScores(stack_scores, heap_scores);
+  ScoreImage(image_words, scores);
+  return MostLikely(scores);
+}
+
+int ScoringTables::Classify(const vector<vector<size_t>> &pixels) const {
+  CheckImageSize(pixels);
+  alignas(64) float stack_scores[kMaxStackLanes];
+  vector<float> heap_scores;
+  float *scores = StartScores(stack_scores, heap_scores);
+
+  size_t rows[kRowBatchSize];
+  size_t count = 0;
+  for (size_t i = 0; i < pixels.size(); i++) {
+    for (size_t j = 0; j < pixels[i].size(); j++) {
+      if (pixels[i][j] == kShadedPixel) {
+        rows[count++] = i * pixels.size() + j;
+        if (count == kRowBatchSize) {
+          AccumulateRows(interleaved_weights_, lane_count_, rows, count,
+                         scores);
+          count = 0;
+        }
+      }
+    }
+  }
+  AccumulateRows(interleaved_weights_, lane_count_, rows, count, scores);
+  return MostLikely(scores);
+}
+
+int ScoringTables::ClassifyShadedPixels(
+    const vector<size_t> &shaded_pixels) const {
+  size_t number_of_pixels = image_size_ * image_size_;
+  for (const size_t &pixel : shaded_pixels) {
+    if (pixel >= number_of_pixels) {
+      throw std::invalid_argument("shaded pixel is outside the image");
+    }
+  }
+  alignas(64) float stack_scores[kMaxStackLanes];
+  vector<float> heap_scores;
+  float *scores = StartScores(stack_scores, heap_scores);
+  AccumulateRows(interleaved_weights_, lane_count_, shaded_pixels.data(),
+                 shaded_pixels.size(), scores);
+  return MostLikely(scores);
+}
+
+void ScoringTables::ClassifyBatch(const uint64_t *images, size_t count,
+                                  int *predictions) const {
+  BatchScratch scratch;
+  ClassifyBatch(images, count, predictions, scratch);
+}
+
+void ScoringTables::ClassifyBatch(const uint64_t *images, size_t count,
+                                  int *predictions,
+                                  BatchScratch &scratch) const {
+  size_t number_of_pixels = image_size_ * image_size_;
+  size_t words_per_image = image_size_ * Image::WordsPerRow(image_size_);
+  size_t rows_per_block = std::max<size_t>(
+      1, kWeightBlockBytes / (std::max<size_t>(lane_count_, 1) * sizeof(float)));
+  if (scratch.scores.size() < kBatchBlockSize * lane_count_) {
+    scratch.scores.resize(kBatchBlockSize * lane_count_);
+  }
+  float *scores = scratch.scores.data();
+
+  for (size_t first = 0; first < count; first += kBatchBlockSize) {
+    size_t block_size = std::min(kBatchBlockSize, count - first);
+    const uint64_t *block = images + first * words_per_image;
+    for (size_t b = 0; b < block_size; b++) {
+      std::copy(class_biases_, class_biases_ + lane_count_,
+                scores + b * lane_count_);
+    }
+
+    // score the whole block against one slice of the weight table at a time
+    for (size_t row = 0; row < number_of_pixels; row += rows_per_block) {
+      size_t row_end = std::min(number_of_pixels, row + rows_per_block);
+      for (size_t b = 0; b < block_size; b++) {
+        ScorePixelRange(block + b * words_per_image, row, row_end,
+                        scores + b * lane_count_);
+      }
+    }
+
+    for (size_t b = 0; b < block_size; b++) {
+      predictions[first + b] = MostLikely(scores + b * lane_count_);
+    }
+  }
+}
+
+void ScoringTables::ComputePosteriors(const uint64_t *image_words,
+                                      double *posteriors) const {
+  alignas(64) float stack_scores[kMaxStackLanes];
+  vector<float> heap_scores;
+  float *scores = StartScores(stack_scores, heap_scores);
+  ScoreImage(image_words, scores);
+
+  double log_normalizer = LogSumExp(scores);
+  for (size_t c = 0; c < number_of_classes_; c++) {
+    posteriors[c] = std::exp(scores[c] - log_normalizer);
+  }
+}
+
+size_t ScoringTables::FindTopClasses(const uint64_t *image_words, size_t k,
+                                     ClassProbability *top_classes) const {
+  alignas(64) float stack_scores[kMaxStackLanes];
+  vector<float> heap_scores;
+  float *scores = StartScores(stack_scores, heap_scores);
+  ScoreImage(image_words, scores);
+
+  size_t stack_order[kMaxStackLanes];
+  vector<size_t> heap_order;
+  size_t *order = stack_order;
+  if (number_of_classes_ > kMaxStackLanes) {
+    heap_order.resize(number_of_classes_);
+    order = heap_order.data();
+  }
+  for (size_t c = 0; c < number_of_classes_; c++) {
+    order[c] = c;
+  }
+
+  // only the k best classes are ordered
+  size_t found = std::min(k, number_of_classes_);
+  std::partial_sort(order, order + found, order + number_of_classes_,
+                    [scores](size_t a, size_t b) {
+                      return scores[a] > scores[b] ||
+                             (scores[a] == scores[b] && a < b);
+                    });
+
+  double log_normalizer = LogSumExp(scores);
+  for (size_t i = 0; i < found; i++) {
+    top_classes[i].label = (int)labels_[order[i]];
+    top_classes[i].probability = std::exp(scores[order[i]] - log_normalizer);
+  }
+  for (size_t i = found; i < k; i++) {
+    top_classes[i].label = -1;
+    top_classes[i].probability = 0.0;
+  }
+  return found;
+}
+
+void ScoringTables::ComputePosteriorsBatch(const uint64_t *images,
+                                           size_t count,
+                                           double *posteriors) const {
+  size_t words_per_image = image_size_ * Image::WordsPerRow(image_size_);
+  for (size_t i = 0; i < count; i++) {
+    ComputePosteriors(images + i * words_per_image,
+                      posteriors + i * number_of_classes_);
+  }
+}
+
+void ScoringTables::FindTopClassesBatch(const uint64_t *images, size_t count,
+                                        size_t k,
+                                        ClassProbability *top_classes) const {
+  size_t words_per_image = image_size_ * Image::WordsPerRow(image_size_);
+  for (size_t i = 0; i < count; i++) {
+    FindTopClasses(images + i * words_per_image, k, top_classes + i * k);
+  }
+}
+
+void ScoringTables::ScoreImage(const uint64_t *image_words,
+                               float *scores) const {
+  size_t words_per_row = Image::WordsPerRow(image_size_);
+  size_t rows[Image::kBitsPerWord];
+  for (size_t i = 0; i < image_size_; i++) {
+    for (size_t w = 0; w < words_per_row; w++) {
+      uint64_t word = image_words[i * words_per_row + w];
+      size_t count = 0;
+      while (word != 0) {
+        rows[count++] = i * image_size_ + w * Image::kBitsPerWord +
+                        CountTrailingZeros(word);
+        word &= word - 1;
+      }
+      if (count > 0) {
+        AccumulateRows(interleaved_weights_, lane_count_, rows, count, scores);
+      }
+    }
+  }
+}
+
+void ScoringTables::ScorePixelRange(const uint64_t *image_words,
+                                    size_t first_pixel, size_t end_pixel,
+                                    float *scores) const {
+  size_t words_per_row = Image::WordsPerRow(image_size_);
+  size_t rows[kRowBatchSize];
+  size_t count = 0;
+  for (size_t i = first_pixel / image_size_; i * image_size_ < end_pixel;
+       i++) {
+    size_t row_start = i * image_size_;
+    size_t first_column = std::max(first_pixel, row_start) - row_start;
+    size_t end_column = std::min(end_pixel - row_start, image_size_);
+    for (size_t w = first_column / Image::kBitsPerWord;
+         w * Image::kBitsPerWord < end_column; w++) {
+      // keep the bits of the columns in the range
+      size_t word_start = w * Image::kBitsPerWord;
+      uint64_t word = image_words[i * words_per_row + w];
+      if (first_column > word_start) {
+        word &= ~uint64_t(0) << (first_column - word_start);
+      }
+      if (end_column < word_start + Image::kBitsPerWord) {
+        word &= (uint64_t(1) << (end_column - word_start)) - 1;
+      }
+      while (word != 0) {
+        rows[count++] = row_start + word_start + CountTrailingZeros(word);
+        word &= word - 1;
+        if (count == kRowBatchSize) {
+          AccumulateRows(interleaved_weights_, lane_count_, rows, count,
+                         scores);
+          count = 0;
+        }
+      }
+    }
+  }
+  AccumulateRows(interleaved_weights_, lane_count_, rows, count, scores);
+}
+
+double ScoringTables::LogSumExp(const float *scores) const {
+  if (number_of_classes_ == 0) {
+    return 0.0;
+  }
+  double highest_score = *std::max_element(scores, scores + number_of_classes_);
+  double sum = 0.0;
+  for (size_t c = 0; c < number_of_classes_; c++) {
+    sum += std::exp(scores[c] - highest_score);
+  }
+  return highest_score + std::log(sum);
+}
+
+void ScoringTables::CheckImageSize(
+    const vector<vector<size_t>> &pixels) const {
+  if (pixels.size() != image_size_) {
+    throw std::invalid_argument("image size does not match the model");
+  }
+  for (const vector<size_t> &row : pixels) {
+    if (row.size() != image_size_) {
+      throw std::invalid_argument("image size does not match the model");
+    }
+  }
+}
+
+float *ScoringTables::StartScores(float *stack_scores,
+                                  vector<float> &heap_scores) const {
+  float *scores = stack_scores;
+  if (lane_count_ > kMaxStackLanes) {
+    heap_scores.resize(lane_count_);
+    scores = heap_scores.data();
+  }
+  std::copy(class_biases_, class_biases_ + lane_count_, scores);
+  return scores;
+}
+
+int ScoringTables::MostLikely(const float *scores) const {
+  float highest_likelihood = -std::numeric_limits<float>::max();
+  int most_likely = -1;
+  for (size_t c = 0; c < number_of_classes_; c++) {
+    if (scores[c] > highest_likelihood) {
+      highest_likelihood = scores[c];
+      most_likely = labels_[c];
+    }
+  }
+  return most_likely;
+}
+
+// Getters
+size_t ScoringTables::GetImageSize() const { return image_size_; }
+
+const size_t *ScoringTables::GetLabels() const { return labels_; }
+
+size_t ScoringTables::GetNumberOfClasses() const { return number_of_classes_; }
+
+size_t ScoringTables::GetLaneCount() const { return lane_count_; }
+
+const float *ScoringTables::GetInterleavedWeights() const {
+  return interleaved_weights_;
+}
+
+const float *ScoringTables::GetClassBiases() const { return class_biases_; }
+
+}
@@ -0,0 +1,86 @@
+#include <core/thread_pool.h>
+#include <algorithm>
+
+namespace naivebayes {
+
+ThreadPool::ThreadPool(size_t number_of_threads)
+    : task_(nullptr), task_count_(0), next_task_(0), running_workers_(0),
+      generation_(0), stopping_(false) {
+  for (size_t i = 1; i < std::max<size_t>(number_of_threads, 1); i++) {
+    workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_ready_.notify_all();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::ParallelFor(size_t count,
+                             const std::function<void(size_t)> &task) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  task_ = &task;
+  task_count_ = count;
+  next_task_ = 0;
+  error_ = nullptr;
+  generation_++;
+  work_ready_.notify_all();
+
+  RunTasks(lock);
+  work_done_.wait(lock, [this] { return running_workers_ == 0; });
+  task_ = nullptr;
+
+  if (error_) {
+    std::exception_ptr error = error_;
+    error_ = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+void ThreadPool::WorkerLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  size_t seen_generation = generation_;
+  while (true) {
+    work_ready_.wait(lock, [this, seen_generation] {
+      return stopping_ || generation_ != seen_generation;
+    });
+    if (stopping_) {
+      return;
+    }
+    seen_generation = generation_;
+
+    running_workers_++;
+    RunTasks(lock);
+    if (--running_workers_ == 0) {
+      work_done_.notify_all();
+    }
+  }
+}
+
+void ThreadPool::RunTasks(std::unique_lock<std::mutex> &lock) {
+  while (task_ != nullptr && next_task_ < task_count_) {
+    size_t index = next_task_++;
+    const std::function<void(size_t)> &task = *task_;
+    lock.unlock();
+    std::exception_ptr error;
+    try {
+      task(index);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    lock.lock();
+    if (error && !error_) {
+      error_ = error;
+    }
+  }
+}
+
+size_t ThreadPool::GetNumberOfThreads() const { return workers_.size() + 1; }
+
+}
@@ -0,0 +1,110 @@
+#include <core/trace.h>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+namespace naivebayes {
+
+constexpr bool Tracer::kEnabled;
+const size_t Tracer::kMaxEvents;
+
+Tracer::Tracer()
+    : start_(std::chrono::steady_clock::now()), dropped_events_(0) {}
+
+Tracer &Tracer::Get() {
+  static Tracer tracer;
+  return tracer;
+}
+
+void Tracer::RecordScope(const char *name, uint64_t start_nanoseconds,
+                         uint64_t end_nanoseconds) {
+  Record({name, 'X', ThreadNumber(), start_nanoseconds,
+          end_nanoseconds - start_nanoseconds, 0.0});
+}
+
+void Tracer::RecordCounter(const char *name, double value) {
+  Record({name, 'C', ThreadNumber(), Now(), 0, value});
+}
+
+void Tracer::Record(const Event &event) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (events_.size() >= kMaxEvents) {
+    dropped_events_++;
+    return;
+  }
+  events_.push_back(event);
+}
+
+void Tracer::WriteChromeTrace(const std::string &file_path) const {
+  std::string json = FormatChromeTrace();
+  std::ofstream file(file_path, std::ios::binary);
+  if (!file.is_open() || !file.write(json.data(), json.size())) {
+    throw std::invalid_argument("could not write trace file: " + file_path);
+  }
+}
+
+std::string Tracer::FormatChromeTrace() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string json = "{\"traceEvents\":[\n";
+  char line[256];
+  for (size_t i = 0; i < events_.size(); i++) {
+    const Event &event = events_[i];
+    // timestamps and durations are in microseconds
+    if (event.phase == 'X') {
+      snprintf(line, sizeof(line),
+               "{\"name\":\"%s\",\"cat\":\"naivebayes\",\"ph\":\"X\","
+               "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+               event.name, event.timestamp / 1e3, event.duration / 1e3,
+               event.thread);
+    } else {
+      snprintf(line, sizeof(line),
+               "{\"name\":\"%s\",\"cat\":\"naivebayes\",\"ph\":\"C\","
+               "\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"value\":%.17g}}",
+               event.name, event.timestamp / 1e3, event.thread, event.value);
+    }
+    json += line;
+    json += i + 1 < events_.size() ? ",\n" : "\n";
+  }
+  json += "],\n\"displayTimeUnit\":\"ns\",\n\"otherData\":{\"dropped_events\":" +
+          std::to_string(dropped_events_) + "}}\n";
+  return json;
+}
+
+void Tracer::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  events_.clear();
+  dropped_events_ = 0;
+}
+
+uint64_t Tracer::Now() const {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start_).count();
+}
+
+uint32_t Tracer::ThreadNumber() {
+  static std::atomic<uint32_t> next_thread(1);
+  thread_local uint32_t thread = next_thread++;
+  return thread;
+}
+
+// Getters
+size_t Tracer::GetNumberOfEvents() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return events_.size();
+}
+
+size_t Tracer::GetDroppedEvents() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return dropped_events_;
+}
+
+TraceScope::TraceScope(const char *name)
+    : name_(name), start_(Tracer::Get().Now()) {}
+
+TraceScope::~TraceScope() {
+  Tracer &tracer = Tracer::Get();
+  tracer.RecordScope(name_, start_, tracer.Now());
+}
+
+}
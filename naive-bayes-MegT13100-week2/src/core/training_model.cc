@@ -1,7 +1,17 @@
 #include <core/file_handler.h>
+#include <core/mapped_file.h>
+#include <core/record_reader.h>
+#include <core/scoring_kernel.h>
+#include <core/trace.h>
+#include <core/training_pipeline.h>
 #include <core/training_model.h>
+#include <algorithm>
+#include <charconv>
 #include <map>
 #include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <thread>
 #include <vector>
 
 // rename this class to model
@@ -11,182 +21,695 @@ using std::vector;
 
 namespace naivebayes {
 
-TrainingModel::TrainingModel(Data &data) : data_(data) {
-  SetPriorProbabilities(data);
+const size_t TrainingModel::kNumberOfShades;
 
-  InitializeFeatureProbVector();
-  ComputeFeatureProbabilities(data);
+TrainingModel::TrainingModel(Data &data, size_t number_of_threads,
+                             CountingKernel counting_kernel)
+    : data_(data), counts_(0, 0), has_counts_(false) {
+  SetClassIndex(data.GetLabels());
+
+  InitializeFeatureProbTable();
+  ComputeFeatureProbabilities(data, number_of_threads, counting_kernel);
+  SetPriorProbabilities();
+  ComputeLogProbabilities();
 }
 
-TrainingModel::TrainingModel(const size_t image_size) : data_(image_size) {}
+TrainingModel::TrainingModel(const size_t image_size)
+    : data_(image_size), counts_(0, image_size * image_size),
+      has_counts_(true) {}
 
-void TrainingModel::InitializeFeatureProbVector() {
-  for (size_t i = 0; i < data_.GetImageSize(); i++) {
-    feature_probability_vector_.emplace_back();
-    for (size_t j = 0; j < data_.GetImageSize(); j++) {
-      feature_probability_vector_[i].emplace_back();
-      for (size_t s = 0; s < kNumberOfShades; s++) {
-        feature_probability_vector_[i][j].emplace_back();
-      }
-    }
+void TrainingModel::InitializeFeatureProbTable() {
+  size_t number_of_pixels = data_.GetImageSize() * data_.GetImageSize();
+  feature_probabilities_.assign(
+      class_index_.size() * number_of_pixels * kNumberOfShades, 0.0);
+}
+
+void TrainingModel::SetClassIndex(const vector<size_t> &labels) {
+  vector<size_t> sorted_labels = labels;
+  std::sort(sorted_labels.begin(), sorted_labels.end());
+  class_index_ = ClassIndex(sorted_labels);
+  stale_classes_.assign(class_index_.size(), false);
+}
+
+size_t TrainingModel::TableIndex(size_t class_index, size_t pixel,
+                                 size_t shade) const {
+  size_t number_of_pixels = data_.GetImageSize() * data_.GetImageSize();
+  return (class_index * number_of_pixels + pixel) * kNumberOfShades +
+         shade;
+}
+
+void TrainingModel::ComputeLogProbabilities() {
+  NAIVEBAYES_TRACE_SCOPE("train/log_probabilities");
+  size_t number_of_pixels = data_.GetImageSize() * data_.GetImageSize();
+  unshaded_baselines_.assign(class_index_.size(), 0.0);
+  shaded_deltas_.resize(class_index_.size() * number_of_pixels);
+  lane_count_ = PaddedLaneCount(class_index_.size());
+  class_biases_.assign(lane_count_, 0.0f);
+  interleaved_weights_.assign(number_of_pixels * lane_count_, 0.0f);
+
+  for (size_t c = 0; c < class_index_.size(); c++) {
+    ComputeClassLogProbabilities(c);
+  }
+  ComputeLogPriors();
+}
+
+void TrainingModel::ComputeClassLogProbabilities(size_t class_index) {
+  size_t number_of_pixels = data_.GetImageSize() * data_.GetImageSize();
+  double baseline = 0.0;
+  for (size_t pixel = 0; pixel < number_of_pixels; pixel++) {
+    double log_unshaded = log(
+        feature_probabilities_[TableIndex(class_index, pixel, kUnshadedPixel)]);
+    double log_shaded = log(
+        feature_probabilities_[TableIndex(class_index, pixel, kShadedPixel)]);
+    baseline += log_unshaded;
+
+    double delta = log_shaded - log_unshaded;
+    shaded_deltas_[class_index * number_of_pixels + pixel] = delta;
+    interleaved_weights_[pixel * lane_count_ + class_index] = (float)delta;
+  }
+  unshaded_baselines_[class_index] = baseline;
+}
+
+void TrainingModel::ComputeLogPriors() {
+  log_priors_.resize(class_index_.size());
+  for (size_t c = 0; c < class_index_.size(); c++) {
+    log_priors_[c] = log(priors_[c]);
+    class_biases_[c] = (float)(log_priors_[c] + unshaded_baselines_[c]);
+  }
+}
+
+namespace {
+
+// Maximum characters of a shortest round trip double or a size_t.
+const size_t kMaxNumberLength = 32;
+
+const char *SkipWhitespace(const char *position, const char *end) {
+  while (position != end && (*position == ' ' || *position == '\n' ||
+                             *position == '\r' || *position == '\t')) {
+    position++;
+  }
+  return position;
+}
+
+template <typename T>
+const char *ParseOrThrow(const char *position, const char *end, T &value) {
+  position = SkipWhitespace(position, end);
+  if (position == end) {
+    throw std::invalid_argument("Insufficient data in file.");
+  }
+  std::from_chars_result result = std::from_chars(position, end, value);
+  if (result.ec != std::errc()) {
+    throw std::invalid_argument("Invalid number in model file.");
   }
+  return result.ptr;
 }
 
-template <typename T> void TryReadOrThrow(std::istream &is, T &obj) {
-  if (!(is >> obj)) {
+// Powers of ten that are exact doubles.
+const double kExactPowersOfTen[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                    1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15};
+
+// Decimal digits that always fit in the 53 bit mantissa of a double.
+const size_t kMaxExactDigits = 15;
+
+/**
+ * Parses a double, taking a shortcut for plain decimals like 0.00512821,
+ * which is what older models are made of. When the digits fit in an exact
+ * integer and the scale is an exact power of ten, one correctly rounded
+ * division gives the same double as from_chars; anything else, such as
+ * exponents or long shortest round trip output, goes to from_chars.
+ */
+template <>
+const char *ParseOrThrow<double>(const char *position, const char *end,
+                                 double &value) {
+  position = SkipWhitespace(position, end);
+  if (position == end) {
     throw std::invalid_argument("Insufficient data in file.");
   }
+
+  // the mantissa may wrap for long numbers, which then take from_chars
+  const char *digit = position;
+  uint64_t mantissa = 0;
+  while (digit != end && *digit >= '0' && *digit <= '9') {
+    mantissa = mantissa * 10 + (*digit++ - '0');
+  }
+  size_t number_of_digits = digit - position;
+  size_t number_of_decimals = 0;
+  if (digit != end && *digit == '.') {
+    const char *fraction = ++digit;
+    while (digit != end && *digit >= '0' && *digit <= '9') {
+      mantissa = mantissa * 10 + (*digit++ - '0');
+    }
+    number_of_decimals = digit - fraction;
+    number_of_digits += number_of_decimals;
+  }
+  bool is_delimited = digit == end || *digit == ' ' || *digit == '\n' ||
+                      *digit == '\r' || *digit == '\t';
+  if (number_of_digits > 0 && number_of_digits <= kMaxExactDigits &&
+      is_delimited) {
+    value = (double)mantissa / kExactPowersOfTen[number_of_decimals];
+    return digit;
+  }
+
+  std::from_chars_result result = std::from_chars(position, end, value);
+  if (result.ec != std::errc()) {
+    throw std::invalid_argument("Invalid number in model file.");
+  }
+  return result.ptr;
+}
+
+template <typename T> char *Format(char *position, char *end, T value) {
+  return std::to_chars(position, end, value).ptr;
+}
+
 }
 
 std::istream &operator>>(std::istream &is, TrainingModel &training_model) {
+  std::ostringstream buffer;
+  if (is.peek() != std::char_traits<char>::eof()) {
+    buffer << is.rdbuf();
+  }
+  std::string text = buffer.str();
+  training_model.ParseTextModel(text.data(), text.data() + text.size());
+  return is;
+}
+
+std::ostream &operator<<(std::ostream &os, TrainingModel &training_model) {
+  std::string text = training_model.FormatTextModel();
+  os.write(text.data(), text.size());
+  return os;
+}
+
+void TrainingModel::LoadTextModel(const std::string &file_path) {
+  NAIVEBAYES_TRACE_SCOPE("load/text_model");
+  MappedFile file(file_path);
+  ParseTextModel(file.GetData(), file.GetData() + file.GetSize());
+}
+
+void TrainingModel::SaveTextModel(const std::string &file_path) const {
+  NAIVEBAYES_TRACE_SCOPE("save/text_model");
+  std::string text = FormatTextModel();
+  std::ofstream file(file_path, std::ios::binary | std::ios::trunc);
+  if (!file.write(text.data(), text.size())) {
+    throw std::invalid_argument("could not write model file: " + file_path);
+  }
+}
+
+void TrainingModel::ParseTextModel(const char *begin, const char *end) {
   size_t num_of_priors = 0;
-  TryReadOrThrow<size_t>(is, num_of_priors);
+  const char *position = ParseOrThrow(begin, end, num_of_priors);
 
   size_t key = 0;
   double value = 0;
 
+  class_index_.Clear();
+  priors_.clear();
+  has_counts_ = false;
+  has_stale_classes_ = false;
   for (size_t i = 0; i < num_of_priors; ++i) {
-    TryReadOrThrow<size_t>(is, key);
-    TryReadOrThrow<double>(is, value);
-    training_model.labels_.push_back(key);
-    training_model.prior_probability_map_[key] = value;
-  }
-
-  // clear
-  training_model.feature_probability_vector_.clear();
-
-  // resize before every level except for last level because it's a map
-  training_model.feature_probability_vector_.resize(
-      training_model.GetData().GetImageSize());
-  for (size_t i = 0; i < training_model.GetData().GetImageSize(); i++) {
-    training_model.feature_probability_vector_[i].resize(
-        training_model.GetData().GetImageSize());
-    for (size_t j = 0; j < training_model.GetData().GetImageSize(); j++) {
-      training_model.feature_probability_vector_[i][j].resize(
-          training_model.kNumberOfShades);
-      for (size_t s = 0; s < training_model.kNumberOfShades; s++) {
-        for (size_t c = 0; c < num_of_priors; c++) {
-          TryReadOrThrow<double>(
-              is, training_model.feature_probability_vector_[i][j][s][c]);
-        }
-      }
+    position = ParseOrThrow(position, end, key);
+    position = ParseOrThrow(position, end, value);
+    if (class_index_.Insert(key) != i) {
+      throw std::invalid_argument("Repeated label in model file.");
     }
+    priors_.push_back(value);
   }
+  stale_classes_.assign(num_of_priors, false);
 
-  return is;
+  // features are stored pixel by pixel, with one value per shade and class
+  InitializeFeatureProbTable();
+  size_t number_of_pixels = data_.GetImageSize() * data_.GetImageSize();
+  size_t class_stride = number_of_pixels * kNumberOfShades;
+  for (size_t pixel = 0; pixel < number_of_pixels; pixel++) {
+    for (size_t s = 0; s < kNumberOfShades; s++) {
+      double *probability = &feature_probabilities_[TableIndex(0, pixel, s)];
+      for (size_t c = 0; c < num_of_priors; c++) {
+        position = ParseOrThrow(position, end, probability[c * class_stride]);
+      }
+    }
+  }
+  ComputeLogProbabilities();
 }
 
-std::ostream &operator<<(std::ostream &os, TrainingModel &training_model) {
-  os << training_model.prior_probability_map_.size() << std::endl;
-  for (const auto &prob : training_model.prior_probability_map_) {
-    os << prob.first << training_model.kSpace << prob.second
-       << training_model.kSpace;
-  }
-
-  for (size_t i = 0; i < training_model.GetData().GetImageSize(); i++) {
-    for (size_t j = 0; j < training_model.GetData().GetImageSize(); j++) {
-      for (size_t s = 0; s < training_model.kNumberOfShades; s++) {
-        for (const size_t &c:training_model.GetData().GetLabels()) {
-          float value = training_model.feature_probability_vector_[i][j][s][c];
-          os << value << training_model.kSpace;
-        }
+std::string TrainingModel::FormatTextModel() const {
+  CheckProbabilitiesAreCurrent();
+  size_t number_of_pixels = data_.GetImageSize() * data_.GetImageSize();
+  size_t number_of_values =
+      class_index_.size() * (2 + number_of_pixels * kNumberOfShades);
+  std::string text(kMaxNumberLength * (number_of_values + 1), '\0');
+  char *position = &text[0];
+  char *end = position + text.size();
+
+  position = Format(position, end, class_index_.size());
+  *position++ = '\n';
+  for (size_t c = 0; c < class_index_.size(); c++) {
+    position = Format(position, end, class_index_.GetLabel(c));
+    *position++ = kSpace;
+    position = Format(position, end, priors_[c]);
+    *position++ = kSpace;
+  }
+
+  for (size_t pixel = 0; pixel < number_of_pixels; pixel++) {
+    for (size_t s = 0; s < kNumberOfShades; s++) {
+      for (size_t c = 0; c < class_index_.size(); c++) {
+        position =
+            Format(position, end, feature_probabilities_[TableIndex(c, pixel, s)]);
+        *position++ = kSpace;
       }
     }
   }
-  return os;
+  text.resize(position - text.data());
+  return text;
 }
 
-void TrainingModel::SetPriorProbabilities(Data &data) {
-  for (const Image &img : data.GetImages()) {
-    if(class_count_.count(img.GetLabel())==0){
-      class_count_[img.GetLabel()] = 0;
+void TrainingModel::SaveModelFile(const std::string &file_path) const {
+  NAIVEBAYES_TRACE_SCOPE("save/model_file");
+  CheckProbabilitiesAreCurrent();
+  vector<uint64_t> labels(class_index_.GetLabels().begin(),
+                          class_index_.GetLabels().end());
+
+  ModelFileSections sections;
+  sections.image_size = data_.GetImageSize();
+  sections.number_of_shades = kNumberOfShades;
+  sections.number_of_classes = class_index_.size();
+  sections.lane_count = lane_count_;
+  sections.labels = labels.data();
+  sections.priors = priors_.data();
+  sections.log_priors = log_priors_.data();
+  sections.feature_probabilities = feature_probabilities_.data();
+  sections.unshaded_baselines = unshaded_baselines_.data();
+  sections.shaded_deltas = shaded_deltas_.data();
+  sections.interleaved_weights = interleaved_weights_.data();
+  sections.class_biases = class_biases_.data();
+  sections.class_counts = nullptr;
+  sections.shaded_counts = nullptr;
+  if (has_counts_) {
+    sections.class_counts = counts_.GetClassCounts();
+    sections.shaded_counts = counts_.GetShadedCounts();
+  }
+  ModelFile::Write(file_path, sections);
+}
+
+void TrainingModel::LoadModelFile(const std::string &file_path) {
+  NAIVEBAYES_TRACE_SCOPE("load/model_file");
+  ModelFile file(file_path);
+  ModelFileSections sections = file.GetSections();
+  if (sections.image_size != data_.GetImageSize() ||
+      sections.number_of_shades != kNumberOfShades ||
+      sections.lane_count != PaddedLaneCount(sections.number_of_classes)) {
+    throw std::invalid_argument("model file does not match the model: " +
+                                file_path);
+  }
+
+  size_t classes = sections.number_of_classes;
+  size_t number_of_pixels = data_.GetImageSize() * data_.GetImageSize();
+  class_index_.Clear();
+  for (size_t c = 0; c < classes; c++) {
+    if (class_index_.Insert(sections.labels[c]) != c) {
+      throw std::invalid_argument("repeated label in model file: " +
+                                  file_path);
     }
-    class_count_[img.GetLabel()]++;
   }
-  for (const auto &label : data.GetLabels()) {
-    prior_probability_map_.insert(
-        std::pair<size_t, double>(label, ComputePriorProbabilities(label)));
+  priors_.assign(sections.priors, sections.priors + classes);
+
+  feature_probabilities_.assign(
+      sections.feature_probabilities,
+      sections.feature_probabilities +
+          classes * number_of_pixels * sections.number_of_shades);
+  log_priors_.assign(sections.log_priors, sections.log_priors + classes);
+  unshaded_baselines_.assign(sections.unshaded_baselines,
+                             sections.unshaded_baselines + classes);
+  shaded_deltas_.assign(sections.shaded_deltas,
+                        sections.shaded_deltas + classes * number_of_pixels);
+  lane_count_ = sections.lane_count;
+  interleaved_weights_.assign(sections.interleaved_weights,
+                              sections.interleaved_weights +
+                                  number_of_pixels * lane_count_);
+  class_biases_.assign(sections.class_biases,
+                       sections.class_biases + lane_count_);
+
+  has_counts_ = file.HasCounts();
+  if (has_counts_) {
+    counts_ = FeatureCounts(classes, number_of_pixels, sections.class_counts,
+                            sections.shaded_counts);
+  }
+  stale_classes_.assign(classes, false);
+  has_stale_classes_ = false;
+}
+
+void TrainingModel::SetPriorProbabilities() {
+  priors_.resize(class_index_.size());
+  for (size_t c = 0; c < class_index_.size(); c++) {
+    priors_[c] = ComputePriorProbabilities(c);
+  }
+}
+
+double TrainingModel::ComputePriorProbabilities(size_t class_index) {
+  double numerator = kSmoothingConstant + counts_.GetClassCount(class_index);
+  double denominator =
+      (class_index_.size() * kSmoothingConstant) + counts_.GetTotalCount();
+
+  return numerator / denominator;
+}
+
+void TrainingModel::ComputeFeatureProbabilities(
+    Data &data, size_t number_of_threads, CountingKernel counting_kernel) {
+  NAIVEBAYES_TRACE_SCOPE("train/feature_probabilities");
+  counts_ = CountFeatures(data, number_of_threads, counting_kernel);
+  has_counts_ = true;
+
+  // compute feature
+  for (size_t c = 0; c < class_index_.size(); c++) {
+    ComputeClassProbabilities(c);
+  }
+}
+
+void TrainingModel::ComputeClassProbabilities(size_t class_index) {
+  size_t number_of_pixels = data_.GetImageSize() * data_.GetImageSize();
+  double class_count = counts_.GetClassCount(class_index);
+  double denominator = class_index_.size() * kSmoothingConstant + class_count;
+  for (size_t pixel = 0; pixel < number_of_pixels; pixel++) {
+    double shaded = counts_.GetShadedCount(class_index, pixel);
+    double unshaded = class_count - shaded;
+    feature_probabilities_[TableIndex(class_index, pixel, kUnshadedPixel)] =
+        (unshaded + kSmoothingConstant) / denominator;
+    feature_probabilities_[TableIndex(class_index, pixel, kShadedPixel)] =
+        (shaded + kSmoothingConstant) / denominator;
+  }
+}
+
+// Incremental updates
+void TrainingModel::AddExample(size_t label, const Image &image) {
+  if (!has_counts_) {
+    throw std::logic_error("model has no counts to update");
+  }
+  CheckImageSize(image);
+
+  size_t class_index = class_index_.Find(label);
+  if (class_index == ClassIndex::kNoClass) {
+    class_index = AddClass(label);
+  }
+  counts_.AddImage(class_index, image);
+  stale_classes_[class_index] = true;
+  has_stale_classes_ = true;
+}
+
+void TrainingModel::AddExample(size_t label,
+                               const vector<vector<size_t>> &pixels) {
+  CheckImageSize(pixels);
+  vector<uint64_t> words(data_.GetImageSize() *
+                         Image::WordsPerRow(data_.GetImageSize()));
+  Image::Pack(pixels, data_.GetImageSize(), words.data());
+  AddExample(label, Image(label, data_.GetImageSize(), words.data()));
+}
+
+void TrainingModel::RemoveExample(size_t label, const Image &image) {
+  if (!has_counts_) {
+    throw std::logic_error("model has no counts to update");
   }
+  CheckImageSize(image);
+
+  size_t class_index = class_index_.At(label);
+  counts_.RemoveImage(class_index, image);
+  stale_classes_[class_index] = true;
+  has_stale_classes_ = true;
 }
 
-double TrainingModel::ComputePriorProbabilities(size_t class_number) {
-  double numerator =
-      kSmoothingConstant + class_count_[class_number];
-  size_t denominator = (data_.GetLabels().size() * kSmoothingConstant) +
-                       data_.GetImages().size();
+void TrainingModel::RemoveExample(size_t label,
+                                  const vector<vector<size_t>> &pixels) {
+  CheckImageSize(pixels);
+  vector<uint64_t> words(data_.GetImageSize() *
+                         Image::WordsPerRow(data_.GetImageSize()));
+  Image::Pack(pixels, data_.GetImageSize(), words.data());
+  RemoveExample(label, Image(label, data_.GetImageSize(), words.data()));
+}
+
+size_t TrainingModel::Train(std::istream &is) {
+  NAIVEBAYES_TRACE_SCOPE("train/stream");
+  RecordReader reader(is, data_.GetImageSize());
+  while (reader.Next()) {
+    AddExample(reader.GetLabel(), reader.GetImage());
+  }
+  UpdateProbabilities();
+  NAIVEBAYES_TRACE_COUNTER("train/images", reader.GetRecordCount());
+  return reader.GetRecordCount();
+}
 
-  return (double)numerator / denominator;
+size_t TrainingModel::TrainFile(const std::string &file_path,
+                                size_t number_of_threads) {
+  NAIVEBAYES_TRACE_SCOPE("train/file");
+  std::ifstream file(file_path, std::ios::binary);
+  if (!file.is_open()) {
+    throw std::invalid_argument("could not open file: " + file_path);
+  }
+  if (number_of_threads > 1) {
+    return TrainingPipeline(*this, number_of_threads - 1).Run(file);
+  }
+  return Train(file);
 }
 
-void TrainingModel::ComputeFeatureProbabilities(Data &data) {
-  for (size_t i = 0; i < data.GetImageSize(); i++) {
-    for (size_t j = 0; j < data.GetImageSize(); j++) {
-      for (const Image &img : data.GetImages()) {
-        feature_probability_vector_[i][j][img.GetImage()[i][j]]
-                                   [img.GetLabel()]++;
+void TrainingModel::UpdateProbabilities() {
+  NAIVEBAYES_TRACE_SCOPE("train/update_probabilities");
+  if (!has_stale_classes_) {
+    return;
+  }
+
+  if (unshaded_baselines_.size() != class_index_.size()) {
+    // new classes were appended; they change the layout of every table, and
+    // the number of labels is part of every class's smoothing
+    SortClasses();
+    InitializeFeatureProbTable();
+    for (size_t c = 0; c < class_index_.size(); c++) {
+      ComputeClassProbabilities(c);
+    }
+    SetPriorProbabilities();
+    ComputeLogProbabilities();
+  } else {
+    for (size_t c = 0; c < class_index_.size(); c++) {
+      if (stale_classes_[c]) {
+        ComputeClassProbabilities(c);
+        ComputeClassLogProbabilities(c);
       }
-      // compute feature
-      for (size_t s = 0; s < kNumberOfShades; s++) {
-        for (const size_t &label : data.GetLabels()) {
-          feature_probability_vector_[i][j][s][label] += kSmoothingConstant;
-          feature_probability_vector_[i][j][s][label] /=
-              data.GetLabels().size() * kSmoothingConstant +
-              class_count_[label];
+    }
+    // the total count, and with it every prior, changed
+    SetPriorProbabilities();
+    ComputeLogPriors();
+  }
+
+  stale_classes_.assign(class_index_.size(), false);
+  has_stale_classes_ = false;
+}
+
+size_t TrainingModel::AddClass(size_t label) {
+  size_t class_index = class_index_.Insert(label);
+  counts_.AppendClass();
+  stale_classes_.push_back(true);
+  has_stale_classes_ = true;
+  return class_index;
+}
+
+void TrainingModel::SortClasses() {
+  const vector<size_t> &labels = class_index_.GetLabels();
+  if (std::is_sorted(labels.begin(), labels.end())) {
+    return;
+  }
+  vector<size_t> order(labels.size());
+  for (size_t c = 0; c < order.size(); c++) {
+    order[c] = c;
+  }
+  std::sort(order.begin(), order.end(),
+            [&labels](size_t a, size_t b) { return labels[a] < labels[b]; });
+  vector<size_t> sorted_labels(labels.size());
+  for (size_t c = 0; c < order.size(); c++) {
+    sorted_labels[c] = labels[order[c]];
+  }
+  class_index_ = ClassIndex(sorted_labels);
+  counts_.ReorderClasses(order);
+}
+
+void TrainingModel::CheckProbabilitiesAreCurrent() const {
+  if (has_stale_classes_) {
+    throw std::logic_error("model has counts that UpdateProbabilities() has "
+                           "not applied yet");
+  }
+}
+
+void TrainingModel::CheckImageSize(const Image &image) const {
+  if (image.GetImageSize() != data_.GetImageSize()) {
+    throw std::invalid_argument("image size does not match the model");
+  }
+}
+
+void TrainingModel::CheckImageSize(
+    const vector<vector<size_t>> &pixels) const {
+  if (pixels.size() != data_.GetImageSize()) {
+    throw std::invalid_argument("image size does not match the model");
+  }
+  for (const vector<size_t> &row : pixels) {
+    if (row.size() != data_.GetImageSize()) {
+      throw std::invalid_argument("image size does not match the model");
+    }
+  }
+}
+
+FeatureCounts TrainingModel::CountFeatures(
+    const Data &data, size_t number_of_threads,
+    CountingKernel counting_kernel) const {
+  NAIVEBAYES_TRACE_SCOPE("train/count_features");
+  size_t number_of_pixels = data.GetImageSize() * data.GetImageSize();
+  ImageList images = data.GetImages();
+  number_of_threads =
+      std::max<size_t>(1, std::min(number_of_threads, images.size()));
+
+  vector<FeatureCounts> shards(
+      number_of_threads, FeatureCounts(class_index_.size(), number_of_pixels));
+  size_t chunk_size = (images.size() + number_of_threads - 1) /
+                      number_of_threads;
+  auto count_chunk = [&](size_t shard) {
+    size_t end = std::min(images.size(), (shard + 1) * chunk_size);
+    size_t i = shard * chunk_size;
+    if (counting_kernel == kBitSlicedCounting) {
+      size_t class_indices[FeatureCounts::kBitSliceWidth];
+      for (; i < end; i += FeatureCounts::kBitSliceWidth) {
+        size_t count = std::min<size_t>(FeatureCounts::kBitSliceWidth, end - i);
+        for (size_t b = 0; b < count; b++) {
+          class_indices[b] = class_index_.At(images[i + b].GetLabel());
         }
+        shards[shard].AddImageBlock(images[i].GetWords(), data.GetImageSize(),
+                                    class_indices, count);
       }
+      return;
     }
+    for (; i < end; i++) {
+      shards[shard].AddImage(class_index_.At(images[i].GetLabel()), images[i]);
+    }
+  };
+
+  vector<std::thread> workers;
+  for (size_t shard = 1; shard < number_of_threads; shard++) {
+    workers.emplace_back(count_chunk, shard);
+  }
+  count_chunk(0);
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+
+  // merge in a fixed order so the model is the same for any thread count
+  for (size_t shard = 1; shard < number_of_threads; shard++) {
+    shards[0].Merge(shards[shard]);
   }
+  return shards[0];
 }
 
 // Classify
-int TrainingModel::Classification(const vector<vector<size_t>> &pixels) {
-  double highest_likelihood = -std::numeric_limits<double>::max();
-  int most_likely = -1;
-  for (const size_t& label : labels_) { //data.GetLabels() or labels_
-    double score = Underflow(pixels, label);
-    if (score > highest_likelihood) {
-      highest_likelihood = score;
-      most_likely = label;
-    }
+int TrainingModel::Classification(
+    const vector<vector<size_t>> &pixels) const {
+  NAIVEBAYES_TRACE_SCOPE("classify/image");
+  return GetScoringTables().Classify(pixels);
+}
+
+int TrainingModel::Classification(const Image &image) const {
+  NAIVEBAYES_TRACE_SCOPE("classify/image");
+  CheckImageSize(image);
+  return GetScoringTables().Classify(image.GetWords());
+}
+
+int TrainingModel::ClassifyShadedPixels(
+    const vector<size_t> &shaded_pixels) const {
+  return GetScoringTables().ClassifyShadedPixels(shaded_pixels);
+}
+
+vector<int> TrainingModel::ClassifyBatch(const Data &data) const {
+  if (data.GetImageSize() != data_.GetImageSize()) {
+    throw std::invalid_argument("image size does not match the model");
+  }
+  vector<int> predictions(data.GetImages().size());
+  if (!predictions.empty()) {
+    ClassifyBatch(data.GetImages()[0].GetWords(), predictions.size(),
+                  predictions.data());
   }
-  return most_likely;
+  return predictions;
+}
+
+void TrainingModel::ClassifyBatch(const uint64_t *images, size_t count,
+                                  int *predictions) const {
+  NAIVEBAYES_TRACE_SCOPE("classify/batch");
+  GetScoringTables().ClassifyBatch(images, count, predictions);
+}
+
+void TrainingModel::ClassifyBatch(const uint64_t *images, size_t count,
+                                  int *predictions, BatchScratch &scratch) const {
+  NAIVEBAYES_TRACE_SCOPE("classify/batch");
+  GetScoringTables().ClassifyBatch(images, count, predictions, scratch);
 }
 
 // Math
 double TrainingModel::Underflow(const vector<vector<size_t>> &pixels,
-                                size_t class_number) {
-  double prior_probability = log(prior_probability_map_[class_number]);
-  double feature_probability = UnderflowHelper(pixels, class_number);
-
-  std::cout << prior_probability + feature_probability;
+                                size_t class_number) const {
+  CheckProbabilitiesAreCurrent();
+  size_t class_index = class_index_.At(class_number);
+  double prior_probability = log_priors_[class_index];
+  double feature_probability = UnderflowHelper(pixels, class_index);
   return prior_probability + feature_probability;
 }
 
 double TrainingModel::UnderflowHelper(const vector<vector<size_t>> &pixels,
-                                      size_t class_number) {
-  double total_log_sum = 0.0;
-  for (size_t i = 0; i < data_.GetImageSize(); i++) {
-    for (size_t j = 0; j < data_.GetImageSize(); j++) {
-      auto tmp =
-          // error is here, feature is not set correctly
-          log(feature_probability_vector_[i][j][pixels[i][j]][class_number]);
-      total_log_sum += tmp;
+                                      size_t class_index) const {
+  CheckImageSize(pixels);
+  size_t number_of_pixels = data_.GetImageSize() * data_.GetImageSize();
+  const double *deltas = &shaded_deltas_[class_index * number_of_pixels];
+  double total_log_sum = unshaded_baselines_[class_index];
+  for (size_t i = 0; i < pixels.size(); i++) {
+    for (size_t j = 0; j < pixels[i].size(); j++) {
+      if (pixels[i][j] == kShadedPixel) {
+        total_log_sum += deltas[i * pixels.size() + j];
+      }
     }
   }
   return total_log_sum;
 }
 
 // Getters
-std::map<size_t, double> TrainingModel::GetPriorProbabilities() {
-  return prior_probability_map_;
+std::map<size_t, double> TrainingModel::GetPriorProbabilities() const {
+  CheckProbabilitiesAreCurrent();
+  std::map<size_t, double> prior_probabilities;
+  for (size_t c = 0; c < class_index_.size(); c++) {
+    prior_probabilities[class_index_.GetLabel(c)] = priors_[c];
+  }
+  return prior_probabilities;
 }
 
-vector<vector<vector<std::map<size_t, double>>>>
-TrainingModel::GetFeatureProbabilities() {
-  return feature_probability_vector_;
+const vector<double> &TrainingModel::GetPriors() const { return priors_; }
+
+FeatureProbabilityView TrainingModel::GetFeatureProbabilities() const {
+  CheckProbabilitiesAreCurrent();
+  return FeatureProbabilityView(feature_probabilities_.data(), class_index_,
+                                data_.GetImageSize(),
+                                kNumberOfShades);
+}
+
+const vector<size_t> &TrainingModel::GetLabels() const {
+  return class_index_.GetLabels();
+}
+
+const ClassIndex &TrainingModel::GetClassIndex() const { return class_index_; }
+
+const vector<double> &TrainingModel::GetLogPriors() const {
+  return log_priors_;
+}
+
+ScoringTables TrainingModel::GetScoringTables() const {
+  CheckProbabilitiesAreCurrent();
+  return ScoringTables(data_.GetImageSize(), class_index_.GetLabels().data(),
+                       class_index_.size(), lane_count_,
+                       interleaved_weights_.data(), class_biases_.data());
 }
 
-const Data &TrainingModel::GetData() { return data_; }
+const FeatureCounts &TrainingModel::GetCounts() const { return counts_; }
+
+bool TrainingModel::HasCounts() const { return has_counts_; }
+
+const Data &TrainingModel::GetData() const { return data_; }
 
 
-} // namespace naivebayes
\ No newline at end of file
+} // namespace naivebayes
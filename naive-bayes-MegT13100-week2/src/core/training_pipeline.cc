@@ -0,0 +1,180 @@
+#include <core/training_pipeline.h>
+#include <core/trace.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace naivebayes {
+
+const size_t TrainingPipeline::kDefaultBlockBytes;
+const size_t TrainingPipeline::kDefaultQueueCapacity;
+
+TrainingPipeline::TrainingPipeline(TrainingModel &model,
+                                   size_t number_of_parsers,
+                                   size_t block_bytes, size_t queue_capacity)
+    : model_(model), image_size_(model.GetData().GetImageSize()),
+      number_of_parsers_(std::max<size_t>(number_of_parsers, 1)),
+      block_bytes_(std::max<size_t>(block_bytes, 1)),
+      queue_capacity_(std::max<size_t>(queue_capacity, 1)), stopping_(false),
+      error_sequence_(std::numeric_limits<size_t>::max()) {}
+
+size_t TrainingPipeline::Run(std::istream &is) {
+  NAIVEBAYES_TRACE_SCOPE("train/pipeline");
+  if (!model_.HasCounts()) {
+    throw std::logic_error("model has no counts to update");
+  }
+  stopping_ = false;
+  error_ = nullptr;
+  error_sequence_ = std::numeric_limits<size_t>::max();
+
+  BoundedQueue<Block> blocks(queue_capacity_);
+  BoundedQueue<Batch> batches(queue_capacity_);
+  std::atomic<size_t> running_parsers(number_of_parsers_);
+
+  std::thread reader([&] {
+    try {
+      ReadBlocks(is, blocks);
+    } catch (...) {
+      RecordError(std::current_exception(), 0);
+    }
+    blocks.Close();
+  });
+  std::vector<std::thread> parsers;
+  for (size_t i = 0; i < number_of_parsers_; i++) {
+    parsers.emplace_back([&] {
+      ParseBlocks(blocks, batches);
+      if (--running_parsers == 0) {
+        batches.Close();
+      }
+    });
+  }
+
+  // count on this thread; counts do not depend on the order of the batches
+  size_t number_of_images = 0;
+  Batch batch;
+  batch.sequence = 0;
+  try {
+    while (batches.Pop(batch)) {
+      NAIVEBAYES_TRACE_SCOPE("train/count_batch");
+      // the batches after a malformed record are drained, not counted
+      if (IsAfterError(batch.sequence)) {
+        continue;
+      }
+      for (const Image &image : batch.data->GetImages()) {
+        model_.AddExample(image.GetLabel(), image);
+      }
+      number_of_images += batch.data->GetImages().size();
+    }
+  } catch (...) {
+    RecordError(std::current_exception(), batch.sequence);
+    blocks.Close();
+    batches.Close();
+  }
+
+  reader.join();
+  for (std::thread &parser : parsers) {
+    parser.join();
+  }
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+
+  model_.UpdateProbabilities();
+  NAIVEBAYES_TRACE_COUNTER("train/images", number_of_images);
+  return number_of_images;
+}
+
+void TrainingPipeline::ReadBlocks(std::istream &is,
+                                  BoundedQueue<Block> &blocks) {
+  size_t lines_per_record = image_size_ + 1;
+  size_t line_number = 1;
+  size_t sequence = 0;
+
+  // bytes read past the last whole record, carried into the next block
+  std::string carry;
+  std::vector<char> buffer(block_bytes_);
+  while (!stopping_) {
+    NAIVEBAYES_TRACE_SCOPE("train/read_block");
+    is.read(buffer.data(), buffer.size());
+    size_t bytes_read = is.gcount();
+    carry.append(buffer.data(), bytes_read);
+    bool at_end = bytes_read < buffer.size();
+
+    // cut after the last line break that ends a whole record
+    size_t line_breaks = 0;
+    size_t cut = 0;
+    size_t cut_line_breaks = 0;
+    const char *cursor = carry.data();
+    const char *end = carry.data() + carry.size();
+    while ((cursor = static_cast<const char *>(
+                memchr(cursor, '\n', end - cursor))) != nullptr) {
+      cursor++;
+      if (++line_breaks % lines_per_record == 0) {
+        cut = cursor - carry.data();
+        cut_line_breaks = line_breaks;
+      }
+    }
+    if (at_end) {
+      cut = carry.size();
+      cut_line_breaks = line_breaks;
+    }
+    if (cut > 0) {
+      Block block;
+      block.text = carry.substr(0, cut);
+      block.first_line_number = line_number;
+      block.sequence = sequence++;
+      carry.erase(0, cut);
+      line_number += cut_line_breaks;
+      if (!blocks.Push(std::move(block))) {
+        return;
+      }
+    }
+    if (at_end) {
+      return;
+    }
+  }
+}
+
+void TrainingPipeline::ParseBlocks(BoundedQueue<Block> &blocks,
+                                   BoundedQueue<Batch> &batches) {
+  Block block;
+  while (blocks.Pop(block)) {
+    if (IsAfterError(block.sequence)) {
+      continue;
+    }
+    Batch batch;
+    batch.sequence = block.sequence;
+    batch.data.reset(new Data(image_size_));
+    try {
+      NAIVEBAYES_TRACE_SCOPE("parse/block");
+      batch.data->ParseBlock(block.text.data(),
+                             block.text.data() + block.text.size(),
+                             block.first_line_number);
+    } catch (...) {
+      RecordError(std::current_exception(), block.sequence);
+      continue;
+    }
+    if (!batches.Push(std::move(batch))) {
+      return;
+    }
+  }
+}
+
+void TrainingPipeline::RecordError(std::exception_ptr error,
+                                   size_t sequence) {
+  std::lock_guard<std::mutex> lock(error_mutex_);
+  if (!error_ || sequence < error_sequence_) {
+    error_ = error;
+    error_sequence_ = sequence;
+  }
+  stopping_ = true;
+}
+
+bool TrainingPipeline::IsAfterError(size_t sequence) {
+  std::lock_guard<std::mutex> lock(error_mutex_);
+  return error_ && sequence > error_sequence_;
+}
+
+}
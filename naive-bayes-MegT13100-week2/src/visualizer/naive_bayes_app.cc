@@ -6,13 +6,20 @@ namespace visualizer {
 
 NaiveBayesApp::NaiveBayesApp()
     : sketchpad_(glm::vec2(kMargin, kMargin), kImageDimension,
-                 kWindowSize - 2 * kMargin), trainer_(kImageDimension) {
-  std::ifstream is;
-  is.open("../../../../../../data/outstream_file.txt");\
-  is >> trainer_;
+                 kWindowSize - 2 * kMargin),
+      model_(ModelPath(), kImageDimension) {
   ci::app::setWindowSize((int) kWindowSize, (int) kWindowSize);
 }
 
+std::string NaiveBayesApp::ModelPath() {
+  // prefer the binary model file, which is used in place without parsing
+  const std::string model_file_path = "../../../../../../data/model.nbm";
+  if (ModelFile::IsModelFile(model_file_path)) {
+    return model_file_path;
+  }
+  return "../../../../../../data/outstream_file.txt";
+}
+
 void NaiveBayesApp::draw() {
   ci::Color8u background_color(255, 246, 148);  // light yellow
   ci::gl::clear(background_color);
@@ -20,7 +27,8 @@ void NaiveBayesApp::draw() {
   sketchpad_.Draw();
 
   ci::gl::drawStringCentered(
-      "Press Delete to clear the sketchpad. Press Enter to make a prediction.",
+      "Press Delete to clear the sketchpad. Press Enter to make a prediction. "
+      "Press R to reload the model.",
       glm::vec2(kWindowSize / 2, kMargin / 2), ci::Color("black"));
 
   ci::gl::drawStringCentered(
@@ -39,7 +47,12 @@ void NaiveBayesApp::mouseDrag(ci::app::MouseEvent event) {
 void NaiveBayesApp::keyDown(ci::app::KeyEvent event) {
   switch (event.getCode()) {
     case ci::app::KeyEvent::KEY_RETURN:
-      current_prediction_ = trainer_.Classification(sketchpad_.GetPixelShades());
+      current_prediction_ = model_.Classify(sketchpad_.GetPixelShades());
+      break;
+
+    case ci::app::KeyEvent::KEY_r:
+      // predictions keep using the current model until the new one is in
+      model_.LoadAsync(ModelPath());
       break;
 
     case ci::app::KeyEvent::KEY_BACKSPACE: //original: KEY_DELETE
@@ -0,0 +1,124 @@
+#include <catch2/catch.hpp>
+
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <vector>
+
+#include <core/classifier.h>
+#include <core/data.h>
+#include <core/trace.h>
+#include <core/training_model.h>
+
+// These tests replace the global operator new to count allocations, so they
+// are built into their own executable and every other test keeps the real
+// allocator.
+
+using naivebayes::Pixel;
+
+// AddressSanitizer tracks how every block was allocated and does not expect
+// operator new to be replaced, so allocations are only counted without it
+#if defined(__SANITIZE_ADDRESS__)
+#define NAIVEBAYES_ADDRESS_SANITIZER
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define NAIVEBAYES_ADDRESS_SANITIZER
+#endif
+#endif
+
+namespace {
+
+// allocations made by the current thread, counted by the operator new below
+thread_local size_t allocations = 0;
+
+}
+
+#ifndef NAIVEBAYES_ADDRESS_SANITIZER
+void *operator new(size_t size) {
+  allocations++;
+  void *pointer = std::malloc(size == 0 ? 1 : size);
+  if (pointer == nullptr) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+
+void operator delete(void *pointer, size_t) noexcept { std::free(pointer); }
+#endif
+
+namespace {
+
+// Fills a data set with random images, cycling through the given number of
+// labels.
+naivebayes::Data RandomData(size_t image_size, size_t count,
+                            size_t number_of_labels, std::mt19937 &generator) {
+  naivebayes::Data data(image_size);
+  std::vector<std::vector<size_t>> pixels(image_size,
+                                          std::vector<size_t>(image_size));
+  for (size_t i = 0; i < count; i++) {
+    for (auto &row : pixels) {
+      for (size_t &pixel : row) {
+        pixel = generator() % 3 == 0 ? Pixel::kShadedPixel
+                                     : Pixel::kUnshadedPixel;
+      }
+    }
+    data.AddImage(i % number_of_labels * 3, pixels);
+  }
+  return data;
+}
+
+}
+
+TEST_CASE("Allocation-Free Inference") {
+  std::mt19937 generator(22);
+
+  // 28 has a specialized model, 6 is scored by the generic tables
+  for (size_t image_size : {28, 6}) {
+    naivebayes::Data data = RandomData(image_size, 80, 10, generator);
+    naivebayes::TrainingModel model(data);
+    naivebayes::Classifier classifier(model);
+
+    SECTION("Inference does not allocate, size " +
+            std::to_string(image_size)) {
+      naivebayes::Image image = data.GetImages()[3];
+      std::vector<std::vector<size_t>> pixels = image.GetImage();
+      int label = 0;
+      double underflow = 0.0;
+      double posteriors[2 * 10];
+      naivebayes::ClassProbability top_classes[2 * 3];
+      int predictions[2];
+      naivebayes::BatchScratch scratch;
+      // the first branch-and-bound call builds its tables, the first batch
+      // sizes the scratch
+      classifier.ClassifyBranchAndBound(image);
+      classifier.ClassifyBatch(image.GetWords(), 2, predictions, scratch);
+
+      size_t before = allocations;
+      label += model.Classification(image);
+      label += model.Classification(pixels);
+      label += classifier.Classify(image);
+      label += classifier.Classify(pixels);
+      label += classifier.ClassifyBranchAndBound(image);
+      underflow += model.Underflow(pixels, image.GetLabel());
+      classifier.ComputePosteriors(image, posteriors);
+      classifier.FindTopClasses(image, 3, top_classes);
+      classifier.ComputePosteriorsBatch(image.GetWords(), 2, posteriors);
+      classifier.FindTopClassesBatch(image.GetWords(), 2, 3, top_classes);
+      classifier.ClassifyBatch(image.GetWords(), 2, predictions, scratch);
+      label += predictions[0];
+      model.ClassifyBatch(image.GetWords(), 2, predictions, scratch);
+      label += predictions[0];
+      size_t after = allocations;
+
+      REQUIRE(label == 7 * model.Classification(image));
+      REQUIRE(top_classes[0].label == label / 7);
+      REQUIRE(underflow == model.Underflow(pixels, image.GetLabel()));
+      // recording trace events allocates
+      if (!naivebayes::Tracer::kEnabled) {
+        REQUIRE(after == before);
+      }
+    }
+  }
+}
@@ -0,0 +1,190 @@
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <core/classifier.h>
+#include <core/data.h>
+#include <core/model_holder.h>
+#include <core/training_model.h>
+
+using naivebayes::Pixel;
+
+namespace {
+
+// Fills a data set with random images, cycling through the given number of
+// labels.
+naivebayes::Data RandomData(size_t image_size, size_t count,
+                            size_t number_of_labels, std::mt19937 &generator) {
+  naivebayes::Data data(image_size);
+  std::vector<std::vector<size_t>> pixels(image_size,
+                                          std::vector<size_t>(image_size));
+  for (size_t i = 0; i < count; i++) {
+    for (auto &row : pixels) {
+      for (size_t &pixel : row) {
+        pixel = generator() % 3 == 0 ? Pixel::kShadedPixel
+                                     : Pixel::kUnshadedPixel;
+      }
+    }
+    data.AddImage(i % number_of_labels * 3, pixels);
+  }
+  return data;
+}
+
+// Results of every inference method for one image, computed on one thread.
+struct Expected {
+  int model_label;
+  int classifier_label;
+  double underflow;
+};
+
+// Classifies every image of a data set with every inference method, from
+// several threads at once, and counts the results that differ from a
+// single thread's.
+size_t CountConcurrentMismatches(const naivebayes::TrainingModel &model,
+                                 const naivebayes::Classifier &classifier,
+                                 const naivebayes::Data &data,
+                                 size_t number_of_threads, size_t rounds) {
+  naivebayes::ImageList images = data.GetImages();
+  std::vector<std::vector<std::vector<size_t>>> pixels;
+  std::vector<Expected> expected;
+  for (const naivebayes::Image &image : images) {
+    pixels.push_back(image.GetImage());
+    expected.push_back({model.Classification(image),
+                        classifier.Classify(image),
+                        model.Underflow(pixels.back(), image.GetLabel())});
+  }
+  std::vector<int> expected_batch = model.ClassifyBatch(data);
+
+  std::atomic<size_t> mismatches(0);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < number_of_threads; t++) {
+    threads.emplace_back([&, t] {
+      std::vector<int> batch(images.size());
+      for (size_t round = 0; round < rounds; round++) {
+        for (size_t k = 0; k < images.size(); k++) {
+          // every thread starts on a different image
+          size_t i = (k + t * 7) % images.size();
+          const naivebayes::Image image = images[i];
+          mismatches += model.Classification(image) != expected[i].model_label;
+          mismatches += model.Classification(pixels[i]) !=
+                        expected[i].model_label;
+          mismatches += classifier.Classify(image) !=
+                        expected[i].classifier_label;
+          mismatches += classifier.Classify(pixels[i]) !=
+                        expected[i].classifier_label;
+          mismatches += classifier.ClassifyBranchAndBound(image) !=
+                        expected[i].classifier_label;
+          mismatches += model.Underflow(pixels[i], image.GetLabel()) !=
+                        expected[i].underflow;
+        }
+        classifier.ClassifyBatch(images[0].GetWords(), batch.size(),
+                                 batch.data());
+        mismatches += batch != expected_batch;
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  return mismatches;
+}
+
+}
+
+TEST_CASE("Concurrent Inference") {
+  std::mt19937 generator(22);
+
+  // 28 has a specialized model, 6 is scored by the generic tables
+  for (size_t image_size : {28, 6}) {
+    naivebayes::Data data = RandomData(image_size, 80, 10, generator);
+    naivebayes::TrainingModel model(data);
+    naivebayes::Classifier classifier(model);
+
+    SECTION("Any number of threads share one model, size " +
+            std::to_string(image_size)) {
+      REQUIRE(CountConcurrentMismatches(model, classifier, data, 8, 10) == 0);
+    }
+  }
+}
+
+TEST_CASE("Model Hot Swap") {
+  std::mt19937 generator(23);
+  naivebayes::Data data = RandomData(6, 60, 5, generator);
+  naivebayes::Data other_data = RandomData(6, 60, 7, generator);
+  naivebayes::TrainingModel model(data);
+  naivebayes::TrainingModel other_model(other_data);
+  naivebayes::ImageList images = data.GetImages();
+
+  const char *file_path = "hot_swap_test.nbm";
+  other_model.SaveModelFile(file_path);
+
+  naivebayes::ModelHolder holder(std::unique_ptr<const naivebayes::Classifier>(
+      new naivebayes::Classifier(model)));
+  REQUIRE(holder.GetVersion() == 1);
+  REQUIRE(holder.Acquire()->GetLabels() == model.GetLabels());
+
+  SECTION("Running classifications keep the old model") {
+    naivebayes::ModelHolder::Snapshot old_snapshot = holder.Acquire();
+    holder.LoadAsync(file_path);
+
+    // the new model is published before the old one is released
+    while (holder.GetVersion() < 2) {
+      std::this_thread::yield();
+    }
+    REQUIRE(holder.Acquire()->GetLabels() == other_model.GetLabels());
+    REQUIRE(old_snapshot->GetLabels() == model.GetLabels());
+    for (const naivebayes::Image &image : images) {
+      REQUIRE(old_snapshot->Classify(image) == model.Classification(image));
+      REQUIRE(holder.Classify(image) == other_model.Classification(image));
+    }
+  }
+
+  SECTION("Failed loads keep the current model") {
+    holder.LoadAsync("no_such_model.nbm");
+    REQUIRE_THROWS_AS(holder.WaitForLoad(), std::invalid_argument);
+    REQUIRE(holder.GetVersion() == 1);
+    REQUIRE(holder.Classify(images[0]) == model.Classification(images[0]));
+  }
+
+  SECTION("Readers always see a whole model while models are swapped") {
+    std::vector<int> expected;
+    std::vector<int> other_expected;
+    for (const naivebayes::Image &image : images) {
+      expected.push_back(model.Classification(image));
+      other_expected.push_back(other_model.Classification(image));
+    }
+
+    std::atomic<bool> stopping(false);
+    std::atomic<size_t> mismatches(0);
+    std::vector<std::thread> readers;
+    for (size_t t = 0; t < 4; t++) {
+      readers.emplace_back([&] {
+        while (!stopping) {
+          for (size_t i = 0; i < images.size(); i++) {
+            naivebayes::ModelHolder::Snapshot snapshot = holder.Acquire();
+            bool is_other = snapshot->GetLabels() == other_model.GetLabels();
+            int label = snapshot->Classify(images[i]);
+            mismatches += label != (is_other ? other_expected : expected)[i];
+          }
+        }
+      });
+    }
+    for (size_t swap = 0; swap < 50; swap++) {
+      holder.Publish(std::unique_ptr<const naivebayes::Classifier>(
+          new naivebayes::Classifier(swap % 2 == 0 ? other_model : model)));
+    }
+    stopping = true;
+    for (std::thread &reader : readers) {
+      reader.join();
+    }
+    REQUIRE(mismatches == 0);
+    REQUIRE(holder.GetVersion() == 51);
+  }
+
+  holder.WaitForLoad();
+  std::remove(file_path);
+}
@@ -1,5 +1,1414 @@
 #include <catch2/catch.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include <core/bit_operations.h>
+#include <core/branch_and_bound_model.h>
+#include <core/class_index.h>
+#include <core/classifier.h>
 #include <core/data.h>
+#include <core/file_handler.h>
+#include <core/fixed_size_model.h>
 #include <core/image.h>
+#include <core/model_file.h>
+#include <core/record_reader.h>
+#include <core/trace.h>
 #include <core/training_model.h>
+#include <core/training_pipeline.h>
+
+TEST_CASE("Packed Images") {
+  SECTION("Pixels survive packing") {
+    std::istringstream input("7\n# +\n   \n+##\n");
+    naivebayes::Data data(3);
+    input >> data;
+
+    std::vector<std::vector<size_t>> pixels {
+        {Pixel::kShadedPixel, Pixel::kUnshadedPixel, Pixel::kShadedPixel},
+        {Pixel::kUnshadedPixel, Pixel::kUnshadedPixel, Pixel::kUnshadedPixel},
+        {Pixel::kShadedPixel, Pixel::kShadedPixel, Pixel::kShadedPixel}
+    };
+
+    REQUIRE(data.GetImages().size() == 1);
+    REQUIRE(data.GetImages().at(0).GetLabel() == 7);
+    REQUIRE(data.GetImages().at(0).GetImage() == pixels);
+    REQUIRE(data.GetImages().at(0).GetWordsPerRow() == 1);
+  }
+
+  SECTION("Rows wider than one word are padded") {
+    std::vector<std::vector<size_t>> pixels(70, std::vector<size_t>(70, 0));
+    pixels[0][0] = Pixel::kShadedPixel;
+    pixels[0][69] = Pixel::kShadedPixel;
+    pixels[69][64] = Pixel::kShadedPixel;
+
+    naivebayes::Data data(70);
+    data.AddImage(2, pixels);
+    data.AddImage(3, pixels);
+
+    naivebayes::Image image = data.GetImages().at(1);
+    REQUIRE(image.GetWordsPerRow() == 2);
+    REQUIRE(image.GetLabel() == 3);
+    REQUIRE(image.GetPixel(0, 69) == Pixel::kShadedPixel);
+    REQUIRE(image.GetPixel(0, 68) == Pixel::kUnshadedPixel);
+    REQUIRE(image.GetImage() == pixels);
+  }
+
+  SECTION("Images share one contiguous buffer") {
+    std::istringstream input("0\n#\n1\n \n2\n+\n");
+    naivebayes::Data data(1);
+    input >> data;
+
+    REQUIRE(data.GetImages().size() == 3);
+    REQUIRE(data.GetImages()[1].GetWords() ==
+            data.GetImages()[0].GetWords() + 1);
+    REQUIRE(data.GetImages()[2].GetWords() ==
+            data.GetImages()[0].GetWords() + 2);
+  }
+
+  SECTION("Pixel vectors of another size are rejected") {
+    naivebayes::Data data(3);
+    std::vector<std::vector<size_t>> pixels(
+        2, std::vector<size_t>(3, Pixel::kShadedPixel));
+    REQUIRE_THROWS_WITH(data.AddImage(1, pixels), "image has 2 of 3 rows");
+    pixels.push_back({Pixel::kShadedPixel});
+    REQUIRE_THROWS_WITH(data.AddImage(1, pixels),
+                        "image row has 1 of 3 pixels");
+    REQUIRE(data.GetImages().empty());
+    REQUIRE(data.GetLabels().empty());
+  }
+}
+
+TEST_CASE("Sparse Scoring") {
+  std::istringstream input("0\n###\n# #\n###\n"
+                           "1\n # \n # \n # \n"
+                           "4\n# #\n###\n  #\n"
+                           "1\n## \n # \n###\n");
+  naivebayes::Data data(3);
+  input >> data;
+  naivebayes::TrainingModel trainer(data);
+
+  SECTION("Matches the dense sum of log probabilities") {
+    for (const naivebayes::Image &img : data.GetImages()) {
+      std::vector<std::vector<size_t>> pixels = img.GetImage();
+      for (const size_t &label : trainer.GetLabels()) {
+        double expected = log(trainer.GetPriorProbabilities().at(label));
+        for (size_t i = 0; i < 3; i++) {
+          for (size_t j = 0; j < 3; j++) {
+            expected +=
+                log(trainer.GetFeatureProbabilities()[i][j][pixels[i][j]][label]);
+          }
+        }
+        REQUIRE(trainer.Underflow(pixels, label) == Approx(expected));
+      }
+    }
+  }
+
+  SECTION("Shaded pixel indices classify like the image") {
+    std::vector<size_t> shaded_pixels;
+    for (const naivebayes::Image &img : data.GetImages()) {
+      img.GetShadedPixels(shaded_pixels);
+      REQUIRE(trainer.ClassifyShadedPixels(shaded_pixels) ==
+              trainer.Classification(img));
+      REQUIRE(trainer.Classification(img) ==
+              trainer.Classification(img.GetImage()));
+    }
+  }
+
+  SECTION("Shaded pixels are found in row major order") {
+    std::vector<size_t> shaded_pixels;
+    data.GetImages().at(2).GetShadedPixels(shaded_pixels);
+    REQUIRE(shaded_pixels == std::vector<size_t>{0, 2, 3, 4, 5, 8});
+  }
+
+  SECTION("Pixels outside the image are rejected") {
+    std::vector<std::vector<size_t>> pixels = data.GetImages()[0].GetImage();
+    pixels[1].push_back(Pixel::kShadedPixel);
+    REQUIRE_THROWS_AS(trainer.Classification(pixels), std::invalid_argument);
+    REQUIRE_THROWS_AS(trainer.Underflow(pixels, 0), std::invalid_argument);
+    pixels.pop_back();
+    REQUIRE_THROWS_AS(trainer.Classification(pixels), std::invalid_argument);
+    REQUIRE_THROWS_AS(trainer.Underflow(pixels, 0), std::invalid_argument);
+
+    REQUIRE_THROWS_AS(trainer.ClassifyShadedPixels({0, 9}),
+                      std::invalid_argument);
+
+    naivebayes::Data other(4);
+    other.AddImage(0, std::vector<std::vector<size_t>>(
+                          4, std::vector<size_t>(4, Pixel::kShadedPixel)));
+    REQUIRE_THROWS_AS(trainer.Classification(other.GetImages()[0]),
+                      std::invalid_argument);
+  }
+}
+
+TEST_CASE("Batch Classification") {
+  SECTION("Matches single image classification") {
+    std::mt19937 generator(7);
+    size_t number_of_classes = 300;
+    naivebayes::Data data(28);
+    std::vector<std::vector<size_t>> pixels(28, std::vector<size_t>(28));
+    for (size_t i = 0; i < 2 * number_of_classes; i++) {
+      for (auto &row : pixels) {
+        for (size_t &pixel : row) {
+          pixel = generator() % 4 == 0 ? Pixel::kShadedPixel
+                                       : Pixel::kUnshadedPixel;
+        }
+      }
+      data.AddImage(i % number_of_classes, pixels);
+    }
+    naivebayes::TrainingModel trainer(data);
+
+    std::vector<int> predictions = trainer.ClassifyBatch(data);
+    REQUIRE(predictions.size() == data.GetImages().size());
+    for (size_t i = 0; i < predictions.size(); i++) {
+      REQUIRE(predictions[i] == trainer.Classification(data.GetImages()[i]));
+    }
+  }
+
+  SECTION("Images wider than a word, with a reused scratch") {
+    std::mt19937 generator(8);
+    naivebayes::Data data(70);
+    std::vector<std::vector<size_t>> pixels(70, std::vector<size_t>(70));
+    for (size_t i = 0; i < 90; i++) {
+      for (auto &row : pixels) {
+        for (size_t &pixel : row) {
+          pixel = generator() % 4 == 0 ? Pixel::kShadedPixel
+                                       : Pixel::kUnshadedPixel;
+        }
+      }
+      data.AddImage(i % 200, pixels);
+    }
+    naivebayes::TrainingModel trainer(data);
+
+    naivebayes::BatchScratch scratch;
+    std::vector<int> predictions(data.GetImages().size());
+    for (size_t round = 0; round < 2; round++) {
+      trainer.ClassifyBatch(data.GetImages()[0].GetWords(),
+                            predictions.size(), predictions.data(), scratch);
+      for (size_t i = 0; i < predictions.size(); i++) {
+        REQUIRE(predictions[i] == trainer.Classification(data.GetImages()[i]));
+      }
+    }
+  }
+
+  SECTION("Empty data set") {
+    std::istringstream input("0\n#\n");
+    naivebayes::Data data(1);
+    input >> data;
+    naivebayes::TrainingModel trainer(data);
+
+    REQUIRE(trainer.ClassifyBatch(naivebayes::Data(1)).empty());
+    REQUIRE_THROWS_AS(trainer.ClassifyBatch(naivebayes::Data(2)),
+                      std::invalid_argument);
+  }
+}
+
+namespace {
+
+// Fills a data set with random images of the given labels.
+void AddRandomImages(naivebayes::Data &data, const std::vector<size_t> &labels,
+                     std::mt19937 &generator) {
+  size_t image_size = data.GetImageSize();
+  std::vector<std::vector<size_t>> pixels(image_size,
+                                          std::vector<size_t>(image_size));
+  for (const size_t &label : labels) {
+    for (auto &row : pixels) {
+      for (size_t &pixel : row) {
+        pixel = generator() % 3 == 0 ? Pixel::kShadedPixel
+                                     : Pixel::kUnshadedPixel;
+      }
+    }
+    data.AddImage(label, pixels);
+  }
+}
+
+// Draws random labels below a bound.
+std::vector<size_t> RandomLabels(size_t count, size_t bound,
+                                 std::mt19937 &generator) {
+  std::vector<size_t> labels(count);
+  for (size_t &label : labels) {
+    label = generator() % bound;
+  }
+  return labels;
+}
+
+// Requires two models to have exactly the same labels and probabilities.
+void RequireSameModel(naivebayes::TrainingModel &actual,
+                      naivebayes::TrainingModel &expected) {
+  REQUIRE(actual.GetLabels() == expected.GetLabels());
+  REQUIRE(actual.GetPriorProbabilities() == expected.GetPriorProbabilities());
+  size_t image_size = expected.GetData().GetImageSize();
+  for (size_t i = 0; i < image_size; i++) {
+    for (size_t j = 0; j < image_size; j++) {
+      for (size_t s = 0; s < 2; s++) {
+        for (const size_t &label : expected.GetLabels()) {
+          REQUIRE(actual.GetFeatureProbabilities()[i][j][s][label] ==
+                  expected.GetFeatureProbabilities()[i][j][s][label]);
+        }
+      }
+    }
+  }
+}
+
+}
+
+TEST_CASE("Multithreaded Training") {
+  std::mt19937 generator(21);
+  naivebayes::Data data(28);
+  AddRandomImages(data, RandomLabels(1000, 10, generator), generator);
+
+  naivebayes::TrainingModel single_threaded(data, 1);
+  for (size_t threads : {2, 3, 8}) {
+    naivebayes::TrainingModel multi_threaded(data, threads);
+    RequireSameModel(multi_threaded, single_threaded);
+  }
+}
+
+TEST_CASE("Bit-Sliced Counting") {
+  std::mt19937 generator(64);
+
+  SECTION("Transposes a bit matrix") {
+    uint64_t matrix[64];
+    uint64_t original[64];
+    for (size_t r = 0; r < 64; r++) {
+      matrix[r] = original[r] = ((uint64_t)generator() << 32) ^ generator();
+    }
+    naivebayes::TransposeBitMatrix64(matrix);
+    for (size_t r = 0; r < 64; r++) {
+      for (size_t c = 0; c < 64; c++) {
+        REQUIRE(((matrix[r] >> c) & 1) == ((original[c] >> r) & 1));
+      }
+    }
+  }
+
+  SECTION("Counts match the image loop") {
+    for (size_t image_size : {5, 28, 70}) {
+      naivebayes::Data data(image_size);
+      AddRandomImages(data, RandomLabels(200, 13, generator), generator);
+      naivebayes::TrainingModel trainer(data);
+
+      for (size_t threads : {1, 3}) {
+        naivebayes::FeatureCounts image_loop = trainer.CountFeatures(
+            data, threads, naivebayes::kImageLoopCounting);
+        naivebayes::FeatureCounts bit_sliced = trainer.CountFeatures(
+            data, threads, naivebayes::kBitSlicedCounting);
+        REQUIRE(bit_sliced.GetNumberOfClasses() ==
+                image_loop.GetNumberOfClasses());
+        for (size_t c = 0; c < image_loop.GetNumberOfClasses(); c++) {
+          REQUIRE(bit_sliced.GetClassCount(c) == image_loop.GetClassCount(c));
+          for (size_t pixel = 0; pixel < image_size * image_size; pixel++) {
+            REQUIRE(bit_sliced.GetShadedCount(c, pixel) ==
+                    image_loop.GetShadedCount(c, pixel));
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("Incremental Training") {
+  std::mt19937 generator(8);
+  naivebayes::Data all_data(5);
+  AddRandomImages(all_data, {3, 1, 3, 2, 1, 3, 2, 2, 9, 1}, generator);
+
+  // the first six images, which have no 9
+  naivebayes::Data first_data(5);
+  for (size_t i = 0; i < 6; i++) {
+    first_data.AddImage(all_data.GetImages()[i].GetLabel(),
+                        all_data.GetImages()[i].GetImage());
+  }
+
+  SECTION("Adding examples matches training on all of them") {
+    naivebayes::TrainingModel expected(all_data);
+    naivebayes::TrainingModel trainer(first_data);
+    for (size_t i = 6; i < all_data.GetImages().size(); i++) {
+      naivebayes::Image img = all_data.GetImages()[i];
+      trainer.AddExample(img.GetLabel(), img);
+    }
+    trainer.UpdateProbabilities();
+
+    RequireSameModel(trainer, expected);
+    for (const naivebayes::Image &img : all_data.GetImages()) {
+      REQUIRE(trainer.Classification(img) == expected.Classification(img));
+    }
+  }
+
+  SECTION("Removing examples matches training without them") {
+    naivebayes::TrainingModel expected(first_data);
+    naivebayes::TrainingModel trainer(all_data);
+    for (size_t i = 6; i < all_data.GetImages().size(); i++) {
+      naivebayes::Image img = all_data.GetImages()[i];
+      trainer.RemoveExample(img.GetLabel(), img.GetImage());
+    }
+    trainer.UpdateProbabilities();
+
+    // the 9 keeps its now empty class, the other classes match exactly
+    REQUIRE(trainer.GetCounts().GetTotalCount() == 6);
+    REQUIRE(trainer.GetLabels() == std::vector<size_t>{1, 2, 3, 9});
+    REQUIRE(trainer.GetCounts().GetClassCount(3) == 0);
+    for (size_t c = 0; c < expected.GetLabels().size(); c++) {
+      REQUIRE(trainer.GetCounts().GetClassCount(c) ==
+              expected.GetCounts().GetClassCount(c));
+      for (size_t pixel = 0; pixel < 25; pixel++) {
+        REQUIRE(trainer.GetCounts().GetShadedCount(c, pixel) ==
+                expected.GetCounts().GetShadedCount(c, pixel));
+      }
+    }
+
+    naivebayes::Image nine = all_data.GetImages()[8];
+    REQUIRE_THROWS_AS(trainer.RemoveExample(9, nine), std::invalid_argument);
+  }
+
+  SECTION("Empty model can be built one example at a time") {
+    naivebayes::TrainingModel expected(all_data);
+    naivebayes::TrainingModel trainer(5);
+    for (const naivebayes::Image &img : all_data.GetImages()) {
+      trainer.AddExample(img.GetLabel(), img);
+    }
+    trainer.UpdateProbabilities();
+    RequireSameModel(trainer, expected);
+  }
+
+  SECTION("Loaded models cannot be updated") {
+    naivebayes::TrainingModel trainer(first_data);
+    std::stringstream stream;
+    stream << trainer;
+    naivebayes::TrainingModel loaded(5);
+    stream >> loaded;
+
+    REQUIRE_FALSE(loaded.HasCounts());
+    REQUIRE_THROWS_AS(
+        loaded.AddExample(1, all_data.GetImages()[0]), std::logic_error);
+  }
+
+  SECTION("New classes are not scored before the update") {
+    naivebayes::TrainingModel expected(all_data);
+    naivebayes::TrainingModel trainer(first_data);
+    naivebayes::Image nine = all_data.GetImages()[8];
+    std::vector<std::vector<size_t>> pixels = nine.GetImage();
+    trainer.AddExample(nine.GetLabel(), nine);
+
+    REQUIRE_THROWS_AS(trainer.Classification(nine), std::logic_error);
+    REQUIRE_THROWS_AS(trainer.Classification(pixels), std::logic_error);
+    REQUIRE_THROWS_AS(trainer.Underflow(pixels, 9), std::logic_error);
+    REQUIRE_THROWS_AS(trainer.Underflow(pixels, 1), std::logic_error);
+    REQUIRE_THROWS_AS(trainer.ClassifyBatch(all_data), std::logic_error);
+    REQUIRE_THROWS_AS(naivebayes::Classifier(trainer), std::logic_error);
+
+    for (size_t i = 6; i < all_data.GetImages().size(); i++) {
+      naivebayes::Image img = all_data.GetImages()[i];
+      if (i != 8) {
+        trainer.AddExample(img.GetLabel(), img);
+      }
+    }
+    trainer.UpdateProbabilities();
+    REQUIRE(trainer.Classification(nine) == expected.Classification(nine));
+    REQUIRE(trainer.Underflow(pixels, 9) ==
+            Approx(expected.Underflow(pixels, 9)));
+  }
+
+  SECTION("Pixel vectors of another size are rejected") {
+    naivebayes::TrainingModel trainer(first_data);
+    std::vector<std::vector<size_t>> pixels(
+        3, std::vector<size_t>(3, Pixel::kShadedPixel));
+    REQUIRE_THROWS_AS(trainer.AddExample(1, pixels), std::invalid_argument);
+    REQUIRE_THROWS_AS(trainer.RemoveExample(1, pixels),
+                      std::invalid_argument);
+    REQUIRE(trainer.GetCounts().GetTotalCount() == 6);
+  }
+}
+
+namespace {
+
+// Requires two data sets to hold the same labels and images.
+void RequireSameData(const naivebayes::Data &actual,
+                     const naivebayes::Data &expected) {
+  REQUIRE(actual.GetLabels() == expected.GetLabels());
+  REQUIRE(actual.GetImages().size() == expected.GetImages().size());
+  for (size_t i = 0; i < expected.GetImages().size(); i++) {
+    REQUIRE(actual.GetImages()[i].GetLabel() ==
+            expected.GetImages()[i].GetLabel());
+    REQUIRE(actual.GetImages()[i].GetImage() ==
+            expected.GetImages()[i].GetImage());
+  }
+}
+
+}
+
+TEST_CASE("Buffer Parsing") {
+  std::string records = "0\n#+#\n# #\n###\n"
+                        "12\n  +\n+ x\n\n"
+                        "4\n# #\n###\n  #\n";
+
+  SECTION("Matches the stream parser") {
+    std::istringstream input(records);
+    naivebayes::Data expected(3);
+    input >> expected;
+
+    naivebayes::Data data(3);
+    data.ParseBuffer(records.data(), records.data() + records.size());
+    RequireSameData(data, expected);
+    REQUIRE(data.GetLabels() == std::vector<size_t>{0, 12, 4});
+  }
+
+  SECTION("Carriage returns and a missing final newline") {
+    std::string windows_records = "7\r\n# \r\n #";
+    naivebayes::Data data(2);
+    data.ParseBuffer(windows_records.data(),
+                     windows_records.data() + windows_records.size());
+
+    std::vector<std::vector<size_t>> pixels {
+        {Pixel::kShadedPixel, Pixel::kUnshadedPixel},
+        {Pixel::kUnshadedPixel, Pixel::kShadedPixel}
+    };
+    REQUIRE(data.GetImages().size() == 1);
+    REQUIRE(data.GetImages()[0].GetLabel() == 7);
+    REQUIRE(data.GetImages()[0].GetImage() == pixels);
+  }
+
+  SECTION("Invalid label") {
+    std::string bad_records = "x\n#\n";
+    naivebayes::Data data(1);
+    REQUIRE_THROWS_AS(
+        data.ParseBuffer(bad_records.data(),
+                         bad_records.data() + bad_records.size()),
+        std::invalid_argument);
+  }
+
+  SECTION("Memory-mapped file") {
+    const char *file_path = "buffer_parsing_test.txt";
+    {
+      std::ofstream output(file_path);
+      output << records;
+    }
+    std::istringstream input(records);
+    naivebayes::Data expected(3);
+    input >> expected;
+
+    naivebayes::Data data(3);
+    data.LoadFile(file_path);
+    std::remove(file_path);
+    RequireSameData(data, expected);
+  }
+}
+
+TEST_CASE("Single Pass File Validation") {
+  const char *file_path = "file_validation_test.txt";
+
+  SECTION("Valid file") {
+    {
+      std::ofstream output(file_path);
+      output << "1\n# \n #\n2\n  \n##\n";
+    }
+    naivebayes::Data data(2);
+    naivebayes::FileHandler file_handler(file_path, data);
+    REQUIRE(file_handler.IsFileValid(file_path));
+    file_handler.HandleFile();
+    std::remove(file_path);
+    REQUIRE(data.GetImages().size() == 2);
+  }
+
+  SECTION("Missing file") {
+    naivebayes::Data data(2);
+    naivebayes::FileHandler file_handler("no_such_file.txt", data);
+    REQUIRE_THROWS_AS(file_handler.HandleFile(), std::invalid_argument);
+  }
+
+  SECTION("Files of one line are rejected as empty") {
+    for (const char *text : {"1\n", "1", "#"}) {
+      {
+        std::ofstream output(file_path);
+        output << text;
+      }
+      naivebayes::Data data(2);
+      naivebayes::FileHandler file_handler(file_path, data);
+      REQUIRE_THROWS_WITH(file_handler.IsFileValid(file_path),
+                          "file is empty");
+      REQUIRE_THROWS_WITH(file_handler.HandleFile(), "file is empty");
+    }
+    std::remove(file_path);
+  }
+
+  SECTION("Invalid label names its line") {
+    {
+      std::ofstream output(file_path);
+      output << "1\n# \n #\nx\n  \n##\n";
+    }
+    naivebayes::Data data(2);
+    naivebayes::FileHandler file_handler(file_path, data);
+    REQUIRE_THROWS_WITH(file_handler.HandleFile(), "line 4: invalid label");
+    std::remove(file_path);
+  }
+
+  SECTION("Truncated record names its line") {
+    {
+      std::ofstream output(file_path);
+      output << "1\n# \n #\n2\n  \n";
+    }
+    naivebayes::Data data(2);
+    naivebayes::FileHandler file_handler(file_path, data);
+    REQUIRE_THROWS_WITH(file_handler.HandleFile(),
+                        "line 4: record has 1 of 2 rows");
+    std::remove(file_path);
+  }
+}
+
+TEST_CASE("Binary Model File") {
+  const char *file_path = "binary_model_file_test.nbm";
+  std::mt19937 generator(11);
+  naivebayes::Data data(5);
+  AddRandomImages(data, {4, 0, 7, 4, 0, 0, 7, 4, 2}, generator);
+  naivebayes::TrainingModel trainer(data);
+  trainer.SaveModelFile(file_path);
+
+  SECTION("Round trip keeps the model exactly") {
+    REQUIRE(naivebayes::ModelFile::IsModelFile(file_path));
+    naivebayes::TrainingModel loaded(5);
+    loaded.LoadModelFile(file_path);
+
+    RequireSameModel(loaded, trainer);
+    REQUIRE(loaded.HasCounts());
+    for (const naivebayes::Image &img : data.GetImages()) {
+      REQUIRE(loaded.Classification(img) == trainer.Classification(img));
+      REQUIRE(loaded.Underflow(img.GetImage(), img.GetLabel()) ==
+              trainer.Underflow(img.GetImage(), img.GetLabel()));
+    }
+  }
+
+  SECTION("Loaded counts can be updated") {
+    naivebayes::TrainingModel loaded(5);
+    loaded.LoadModelFile(file_path);
+    naivebayes::Image img = data.GetImages()[0];
+    loaded.AddExample(img.GetLabel(), img);
+    trainer.AddExample(img.GetLabel(), img);
+    loaded.UpdateProbabilities();
+    trainer.UpdateProbabilities();
+    RequireSameModel(loaded, trainer);
+  }
+
+  SECTION("Sections are aligned in the mapping") {
+    naivebayes::ModelFile file(file_path);
+    naivebayes::ModelFileSections sections = file.GetSections();
+    REQUIRE(file.GetHeader().version == naivebayes::ModelFile::kVersion);
+    REQUIRE(sections.number_of_classes == 4);
+    REQUIRE((uintptr_t)sections.interleaved_weights % 64 == 0);
+    REQUIRE((uintptr_t)sections.shaded_deltas % 64 == 0);
+    REQUIRE(sections.labels[3] == 7);
+  }
+
+  SECTION("Corrupted file") {
+    {
+      std::fstream file(file_path,
+                        std::ios::in | std::ios::out | std::ios::binary);
+      file.seekp(200);
+      file.put('\x5a');
+    }
+    naivebayes::TrainingModel loaded(5);
+    REQUIRE_THROWS_WITH(loaded.LoadModelFile(file_path),
+                        Catch::Contains("checksum mismatch"));
+  }
+
+  SECTION("Other byte order") {
+    {
+      std::fstream file(file_path,
+                        std::ios::in | std::ios::out | std::ios::binary);
+      char magic[4];
+      file.read(magic, sizeof(magic));
+      std::reverse(magic, magic + sizeof(magic));
+      file.seekp(0);
+      file.write(magic, sizeof(magic));
+    }
+    naivebayes::TrainingModel loaded(5);
+    REQUIRE_THROWS_WITH(loaded.LoadModelFile(file_path),
+                        Catch::Contains("other byte order"));
+  }
+
+  SECTION("Text file") {
+    {
+      std::ofstream output(file_path);
+      output << trainer;
+    }
+    REQUIRE_FALSE(naivebayes::ModelFile::IsModelFile(file_path));
+    naivebayes::TrainingModel loaded(5);
+    REQUIRE_THROWS_AS(loaded.LoadModelFile(file_path), std::invalid_argument);
+  }
+
+  SECTION("Different image size") {
+    naivebayes::TrainingModel loaded(3);
+    REQUIRE_THROWS_AS(loaded.LoadModelFile(file_path), std::invalid_argument);
+  }
+
+  std::remove(file_path);
+}
+
+TEST_CASE("Text Model Format") {
+  std::mt19937 generator(12);
+  naivebayes::Data data(4);
+  AddRandomImages(data, {5, 1, 5, 5, 3, 1, 12}, generator);
+  naivebayes::TrainingModel trainer(data);
+
+  SECTION("Round trip is lossless") {
+    std::stringstream stream;
+    stream << trainer;
+    naivebayes::TrainingModel loaded(4);
+    stream >> loaded;
+    RequireSameModel(loaded, trainer);
+
+    std::stringstream saved_again;
+    saved_again << loaded;
+    REQUIRE(saved_again.str() == stream.str());
+  }
+
+  SECTION("Reads the older float precision output") {
+    naivebayes::TrainingModel loaded(1);
+    std::istringstream input("2\n3 0.333333 7 0.666667 "
+                             "0.25 0.5 0.75 1e-05 ");
+    input >> loaded;
+    REQUIRE(loaded.GetLabels() == std::vector<size_t>{3, 7});
+    REQUIRE(loaded.GetPriorProbabilities().at(7) == 0.666667);
+    REQUIRE(loaded.GetFeatureProbabilities()[0][0][1][3] == 0.75);
+    REQUIRE(loaded.GetFeatureProbabilities()[0][0][1][7] == 1e-05);
+  }
+
+  SECTION("Plain decimals read exactly") {
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    for (size_t i = 0; i < 1000; i++) {
+      char text[64];
+      snprintf(text, sizeof(text), i % 2 ? "%.9f" : "%.6g",
+               distribution(generator));
+      naivebayes::TrainingModel loaded(1);
+      std::istringstream input(std::string("1\n0 1 0.5 ") + text);
+      input >> loaded;
+      REQUIRE(loaded.GetFeatureProbabilities()[0][0][1][0] ==
+              strtod(text, nullptr));
+    }
+  }
+
+  SECTION("Memory-mapped file") {
+    const char *file_path = "text_model_format_test.txt";
+    trainer.SaveTextModel(file_path);
+    naivebayes::TrainingModel loaded(4);
+    loaded.LoadTextModel(file_path);
+    std::remove(file_path);
+    RequireSameModel(loaded, trainer);
+  }
+
+  SECTION("Truncated model") {
+    naivebayes::TrainingModel loaded(1);
+    std::istringstream input("2\n3 0.5 7 0.5 0.25 0.5 ");
+    REQUIRE_THROWS_WITH(input >> loaded, "Insufficient data in file.");
+  }
+
+  SECTION("Invalid number") {
+    naivebayes::TrainingModel loaded(1);
+    std::istringstream input("1\n3 x 0.5 0.5 ");
+    REQUIRE_THROWS_WITH(input >> loaded, "Invalid number in model file.");
+  }
+}
+
+TEST_CASE("Streaming Training") {
+  std::string records = "3\n## \n # \n  #\n"
+                        "1\n+  \n+  \n+++\n"
+                        "3\n # \n###\n # \n"
+                        "0\n   \n   \n   \n"
+                        "1\n#  \n#  \n## \n";
+
+  SECTION("Matches training on the whole data set") {
+    std::istringstream data_input(records);
+    naivebayes::Data data(3);
+    data_input >> data;
+    naivebayes::TrainingModel expected(data);
+
+    std::istringstream input(records);
+    naivebayes::TrainingModel trainer(3);
+    REQUIRE(trainer.Train(input) == 5);
+    RequireSameModel(trainer, expected);
+    REQUIRE(trainer.GetCounts().GetTotalCount() == 5);
+  }
+
+  SECTION("Adds to the counts already trained") {
+    std::istringstream data_input(records + records);
+    naivebayes::Data data(3);
+    data_input >> data;
+    naivebayes::TrainingModel expected(data);
+
+    naivebayes::TrainingModel trainer(3);
+    std::istringstream first(records);
+    std::istringstream second(records);
+    trainer.Train(first);
+    trainer.Train(second);
+    RequireSameModel(trainer, expected);
+  }
+
+  SECTION("Reader keeps a single record") {
+    std::istringstream input(records);
+    naivebayes::RecordReader reader(input, 3);
+    REQUIRE(reader.Next());
+    const uint64_t *words = reader.GetImage().GetWords();
+    REQUIRE(reader.GetLabel() == 3);
+    REQUIRE(reader.Next());
+    REQUIRE(reader.GetImage().GetWords() == words);
+    REQUIRE(reader.GetLabel() == 1);
+    REQUIRE(reader.GetImage().GetPixel(2, 2) == Pixel::kShadedPixel);
+    REQUIRE(reader.GetImage().GetPixel(0, 1) == Pixel::kUnshadedPixel);
+  }
+
+  SECTION("Malformed records name their line") {
+    naivebayes::TrainingModel trainer(3);
+    std::istringstream bad_label("3\n## \n # \n  #\nx\n");
+    REQUIRE_THROWS_WITH(trainer.Train(bad_label), "line 5: invalid label");
+    std::istringstream truncated("3\n## \n # \n  #\n1\n#  \n");
+    REQUIRE_THROWS_WITH(trainer.Train(truncated),
+                        "line 5: record has 1 of 3 rows");
+  }
+
+  SECTION("Missing file") {
+    naivebayes::TrainingModel trainer(3);
+    REQUIRE_THROWS_AS(trainer.TrainFile("no_such_file.txt"),
+                      std::invalid_argument);
+  }
+}
+
+TEST_CASE("Inference-Only Classifier") {
+  std::mt19937 generator(14);
+  naivebayes::Data data(6);
+  AddRandomImages(data, {2, 8, 5, 2, 8, 8, 5, 2, 0, 8, 2}, generator);
+  naivebayes::TrainingModel trainer(data);
+  std::vector<int> expected = trainer.ClassifyBatch(data);
+
+  SECTION("Built from a trained model") {
+    naivebayes::Classifier classifier(trainer);
+    REQUIRE(classifier.GetImageSize() == 6);
+    REQUIRE(classifier.GetLabels() == trainer.GetLabels());
+    REQUIRE(classifier.GetLogPriors() == trainer.GetLogPriors());
+    REQUIRE(classifier.GetPriors()[1] ==
+            trainer.GetPriorProbabilities().at(2));
+
+    std::vector<int> predictions(data.GetImages().size());
+    classifier.ClassifyBatch(data.GetImages()[0].GetWords(),
+                             predictions.size(), predictions.data());
+    REQUIRE(predictions == expected);
+    for (size_t i = 0; i < data.GetImages().size(); i++) {
+      naivebayes::Image img = data.GetImages()[i];
+      REQUIRE(classifier.Classify(img) == expected[i]);
+      REQUIRE(classifier.Classify(img.GetImage()) == expected[i]);
+    }
+  }
+
+  SECTION("Outlives the model it was built from") {
+    naivebayes::TrainingModel *temporary = new naivebayes::TrainingModel(data);
+    naivebayes::Classifier classifier(*temporary);
+    delete temporary;
+    for (size_t i = 0; i < data.GetImages().size(); i++) {
+      REQUIRE(classifier.Classify(data.GetImages()[i]) == expected[i]);
+    }
+  }
+
+  SECTION("Built from a model file") {
+    const char *file_path = "classifier_test.nbm";
+    trainer.SaveModelFile(file_path);
+    naivebayes::Classifier loaded(file_path);
+    naivebayes::Classifier classifier(std::move(loaded));
+    std::remove(file_path);
+
+    REQUIRE(classifier.GetLabels() == trainer.GetLabels());
+    for (size_t i = 0; i < data.GetImages().size(); i++) {
+      REQUIRE(classifier.Classify(data.GetImages()[i]) == expected[i]);
+    }
+  }
+
+  SECTION("Different image size") {
+    naivebayes::Classifier classifier(trainer);
+    naivebayes::Data other(3);
+    AddRandomImages(other, {1}, generator);
+    REQUIRE_THROWS_AS(classifier.Classify(other.GetImages()[0]),
+                      std::invalid_argument);
+  }
+}
+
+namespace {
+
+// Writes random records in the data set format, some rows without their
+// trailing spaces and some lines ending in carriage returns.
+std::string RandomRecords(size_t count, size_t image_size,
+                          std::mt19937 &generator) {
+  std::string text;
+  for (size_t i = 0; i < count; i++) {
+    text += std::to_string(generator() % 7 * 3) + "\n";
+    for (size_t row = 0; row < image_size; row++) {
+      std::string line;
+      for (size_t col = 0; col < image_size; col++) {
+        line += " #+"[generator() % 3];
+      }
+      if (generator() % 4 == 0) {
+        line.erase(line.find_last_not_of(' ') + 1);
+      }
+      text += line + (generator() % 5 == 0 ? "\r\n" : "\n");
+    }
+  }
+  return text;
+}
+
+}
+
+TEST_CASE("Parallel Parsing") {
+  std::mt19937 generator(15);
+  std::string text = RandomRecords(3000, 28, generator);
+  naivebayes::Data expected(28);
+  expected.ParseBuffer(text.data(), text.data() + text.size());
+
+  SECTION("Matches one thread for any number of threads") {
+    for (size_t threads = 2; threads <= 5; threads++) {
+      naivebayes::Data data(28);
+      data.ParseBuffer(text.data(), text.data() + text.size(), threads);
+      RequireSameData(data, expected);
+    }
+  }
+
+  SECTION("Missing final line break") {
+    std::string trimmed = text.substr(0, text.size() - 1);
+    naivebayes::Data data(28);
+    data.ParseBuffer(trimmed.data(), trimmed.data() + trimmed.size(), 4);
+    RequireSameData(data, expected);
+  }
+
+  SECTION("Appends to the images already there") {
+    naivebayes::Data data(28);
+    std::string first = RandomRecords(2, 28, generator);
+    data.ParseBuffer(first.data(), first.data() + first.size());
+    data.ParseBuffer(text.data(), text.data() + text.size(), 3);
+
+    naivebayes::Data both(28);
+    std::string all = first + text;
+    both.ParseBuffer(all.data(), all.data() + all.size());
+    RequireSameData(data, both);
+  }
+
+  SECTION("Reports the first error in the file") {
+    std::string broken = text;
+    // the labels of records 1200 and 2500
+    size_t first = broken.find('\n', 0);
+    for (size_t line = 1; line < 1200 * 29; line++) {
+      first = broken.find('\n', first + 1);
+    }
+    size_t second = first;
+    for (size_t line = 0; line < 1300 * 29; line++) {
+      second = broken.find('\n', second + 1);
+    }
+    broken[second + 1] = 'x';
+    broken[first + 1] = 'x';
+
+    naivebayes::Data data(28);
+    REQUIRE_THROWS_WITH(
+        data.ParseBuffer(broken.data(), broken.data() + broken.size(), 4),
+        "line 34801: invalid label");
+    REQUIRE(data.GetImages().empty());
+
+    naivebayes::Data one_thread(28);
+    REQUIRE_THROWS_WITH(
+        one_thread.ParseBuffer(broken.data(), broken.data() + broken.size()),
+        "line 34801: invalid label");
+    REQUIRE(one_thread.GetImages().empty());
+    REQUIRE(one_thread.GetLabels().empty());
+  }
+
+  SECTION("Truncated final record") {
+    std::string truncated = text + "4\n#\n";
+    naivebayes::Data data(28);
+    REQUIRE_THROWS_WITH(
+        data.ParseBuffer(truncated.data(), truncated.data() + truncated.size(),
+                         4),
+        "line 87001: record has 1 of 28 rows");
+  }
+}
+
+TEST_CASE("Training Pipeline") {
+  std::mt19937 generator(16);
+  std::string text = RandomRecords(500, 9, generator);
+  std::istringstream expected_input(text);
+  naivebayes::TrainingModel expected(9);
+  expected.Train(expected_input);
+
+  SECTION("Matches streaming training") {
+    for (size_t parsers = 1; parsers <= 3; parsers++) {
+      std::istringstream input(text);
+      naivebayes::TrainingModel trainer(9);
+      naivebayes::TrainingPipeline pipeline(trainer, parsers, 4096, 2);
+      REQUIRE(pipeline.Run(input) == 500);
+      RequireSameModel(trainer, expected);
+    }
+  }
+
+  SECTION("Blocks smaller than a record and a queue of one") {
+    std::istringstream input(text);
+    naivebayes::TrainingModel trainer(9);
+    naivebayes::TrainingPipeline pipeline(trainer, 2, 7, 1);
+    REQUIRE(pipeline.Run(input) == 500);
+    RequireSameModel(trainer, expected);
+  }
+
+  SECTION("Reports the first error in the stream") {
+    std::string broken = text;
+    size_t line_start = 0;
+    for (size_t line = 1; line < 4001; line++) {
+      line_start = broken.find('\n', line_start) + 1;
+    }
+    broken[line_start] = 'x';
+    broken += "x\n";
+
+    std::istringstream input(broken);
+    naivebayes::TrainingModel trainer(9);
+    naivebayes::TrainingPipeline pipeline(trainer, 3, 512, 2);
+    REQUIRE_THROWS_WITH(pipeline.Run(input), "line 4001: invalid label");
+    // records of 10 lines; none from the broken one on are counted
+    REQUIRE(trainer.GetCounts().GetTotalCount() <= 400);
+  }
+
+  SECTION("Truncated final record") {
+    std::istringstream input(text + "4\n#\n");
+    naivebayes::TrainingModel trainer(9);
+    naivebayes::TrainingPipeline pipeline(trainer, 2, 1024, 2);
+    REQUIRE_THROWS_WITH(pipeline.Run(input),
+                        "line 5001: record has 1 of 9 rows");
+  }
+
+  SECTION("Model without counts") {
+    naivebayes::TrainingModel trainer(9);
+    std::stringstream stream;
+    stream << expected;
+    stream >> trainer;
+    std::istringstream input(text);
+    naivebayes::TrainingPipeline pipeline(trainer, 2);
+    REQUIRE_THROWS_AS(pipeline.Run(input), std::logic_error);
+  }
+}
+
+TEST_CASE("Class Index") {
+  SECTION("Indices follow insertion order") {
+    naivebayes::ClassIndex index;
+    REQUIRE(index.Insert(7) == 0);
+    REQUIRE(index.Insert(1u << 20) == 1);
+    REQUIRE(index.Insert(0) == 2);
+    REQUIRE(index.Insert(7) == 0);
+    REQUIRE(index.Insert(1u << 20) == 1);
+
+    REQUIRE(index.size() == 3);
+    REQUIRE(index.GetLabels() == std::vector<size_t>{7, 1u << 20, 0});
+    REQUIRE(index.Find(0) == 2);
+    REQUIRE(index.At(1u << 20) == 1);
+    REQUIRE(index.GetLabel(1) == 1u << 20);
+  }
+
+  SECTION("Missing labels") {
+    naivebayes::ClassIndex index(std::vector<size_t>{3, 100000});
+    REQUIRE(index.Find(2) == naivebayes::ClassIndex::kNoClass);
+    REQUIRE(index.Find(5000) == naivebayes::ClassIndex::kNoClass);
+    REQUIRE(index.Find(100001) == naivebayes::ClassIndex::kNoClass);
+    REQUIRE_FALSE(index.Contains(4));
+    REQUIRE(index.Contains(100000));
+    REQUIRE_THROWS_AS(index.At(4), std::out_of_range);
+
+    index.Clear();
+    REQUIRE(index.empty());
+    REQUIRE_FALSE(index.Contains(3));
+  }
+
+  SECTION("Thousands of labels train like a few") {
+    std::mt19937 generator(17);
+    std::vector<size_t> labels;
+    for (size_t i = 0; i < 3000; i++) {
+      labels.push_back(generator() % 2500 * 40);
+    }
+    naivebayes::Data data(2);
+    AddRandomImages(data, labels, generator);
+
+    std::vector<size_t> unique_labels;
+    for (const size_t &label : labels) {
+      if (std::find(unique_labels.begin(), unique_labels.end(), label) ==
+          unique_labels.end()) {
+        unique_labels.push_back(label);
+      }
+    }
+    REQUIRE(data.GetLabels() == unique_labels);
+
+    naivebayes::TrainingModel trainer(data);
+    std::sort(unique_labels.begin(), unique_labels.end());
+    REQUIRE(trainer.GetLabels() == unique_labels);
+    for (size_t c = 0; c < unique_labels.size(); c++) {
+      REQUIRE(trainer.GetClassIndex().Find(unique_labels[c]) == c);
+      REQUIRE(trainer.GetPriors()[c] ==
+              trainer.GetPriorProbabilities().at(unique_labels[c]));
+    }
+    for (const naivebayes::Image &img : data.GetImages()) {
+      REQUIRE(trainer.GetClassIndex().Contains(
+          (size_t)trainer.Classification(img)));
+    }
+  }
+
+  SECTION("Repeated label in a text model") {
+    naivebayes::TrainingModel loaded(1);
+    std::istringstream input("2\n3 0.5 3 0.5 0.5 0.5 0.5 0.5 ");
+    REQUIRE_THROWS_WITH(input >> loaded, "Repeated label in model file.");
+  }
+}
+
+TEST_CASE("Fixed Size Model") {
+  std::mt19937 generator(20);
+
+  SECTION("Specializations match the generic scoring tables") {
+    // 3 classes take 8 lanes, 10 take 16
+    for (size_t image_size : {3, 5, 28}) {
+      for (size_t number_of_labels : {3, 10}) {
+        naivebayes::Data data(image_size);
+        std::vector<size_t> labels;
+        for (size_t i = 0; i < 60; i++) {
+          labels.push_back(generator() % number_of_labels * 7);
+        }
+        AddRandomImages(data, labels, generator);
+        naivebayes::TrainingModel trainer(data);
+        std::vector<int> expected = trainer.ClassifyBatch(data);
+
+        std::unique_ptr<const naivebayes::SpecializedModel> model =
+            naivebayes::MakeFixedSizeModel(trainer.GetScoringTables());
+        REQUIRE(model != nullptr);
+        REQUIRE(model->GetImageSize() == image_size);
+
+        naivebayes::Classifier classifier(trainer);
+        for (size_t i = 0; i < data.GetImages().size(); i++) {
+          naivebayes::Image img = data.GetImages()[i];
+          REQUIRE(model->Classify(img.GetWords()) == expected[i]);
+          REQUIRE(classifier.Classify(img) == expected[i]);
+          REQUIRE(classifier.Classify(img.GetImage()) == expected[i]);
+        }
+      }
+    }
+  }
+
+  SECTION("Other image sizes are not specialized") {
+    naivebayes::Data data(6);
+    AddRandomImages(data, {1, 2, 1}, generator);
+    naivebayes::TrainingModel trainer(data);
+    REQUIRE(naivebayes::MakeFixedSizeModel(trainer.GetScoringTables()) ==
+            nullptr);
+  }
+
+  SECTION("Too many classes are not specialized") {
+    naivebayes::Data data(5);
+    std::vector<size_t> labels;
+    for (size_t label = 0; label <= naivebayes::kSpecializedLaneCount;
+         label++) {
+      labels.push_back(label);
+    }
+    AddRandomImages(data, labels, generator);
+    naivebayes::TrainingModel trainer(data);
+    REQUIRE(naivebayes::MakeFixedSizeModel(trainer.GetScoringTables()) ==
+            nullptr);
+
+    naivebayes::Classifier classifier(trainer);
+    std::vector<int> expected = trainer.ClassifyBatch(data);
+    for (size_t i = 0; i < data.GetImages().size(); i++) {
+      REQUIRE(classifier.Classify(data.GetImages()[i]) == expected[i]);
+    }
+  }
+}
+
+TEST_CASE("Tracing") {
+  naivebayes::Tracer &tracer = naivebayes::Tracer::Get();
+  tracer.Clear();
+
+  SECTION("Scopes and counters are written as Chrome trace events") {
+    {
+      naivebayes::TraceScope scope("test/scope");
+    }
+    tracer.RecordCounter("test/counter", 42);
+    REQUIRE(tracer.GetNumberOfEvents() == 2);
+
+    std::string json = tracer.FormatChromeTrace();
+    REQUIRE(json.find("\"traceEvents\"") != std::string::npos);
+    REQUIRE(json.find("\"name\":\"test/scope\",\"cat\":\"naivebayes\","
+                      "\"ph\":\"X\"") != std::string::npos);
+    REQUIRE(json.find("\"ph\":\"C\"") != std::string::npos);
+    REQUIRE(json.find("\"args\":{\"value\":42}") != std::string::npos);
+
+    const char *file_path = "trace_test.json";
+    tracer.WriteChromeTrace(file_path);
+    std::ifstream file(file_path);
+    std::stringstream written;
+    written << file.rdbuf();
+    file.close();
+    std::remove(file_path);
+    REQUIRE(written.str() == json);
+  }
+
+  SECTION("Hooks record only when tracing is built in") {
+    size_t evaluations = 0;
+    NAIVEBAYES_TRACE_COUNTER("test/evaluated", ++evaluations);
+    naivebayes::Data data(3);
+    std::string text = "1\n#  \n # \n  #\n";
+    data.ParseBuffer(text.data(), text.data() + text.size());
+    naivebayes::TrainingModel trainer(data);
+    trainer.Classification(data.GetImages()[0]);
+
+    if (naivebayes::Tracer::kEnabled) {
+      REQUIRE(evaluations == 1);
+      REQUIRE(tracer.FormatChromeTrace().find("parse/buffer") !=
+              std::string::npos);
+      REQUIRE(tracer.FormatChromeTrace().find("classify/image") !=
+              std::string::npos);
+    } else {
+      REQUIRE(evaluations == 0);
+      REQUIRE(tracer.GetNumberOfEvents() == 0);
+    }
+  }
+
+  SECTION("Threads record concurrently") {
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; t++) {
+      threads.emplace_back([&tracer] {
+        for (size_t i = 0; i < 100; i++) {
+          naivebayes::TraceScope scope("test/thread");
+        }
+      });
+    }
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+    REQUIRE(tracer.GetNumberOfEvents() == 400);
+  }
+  tracer.Clear();
+}
+
+TEST_CASE("Posterior Probabilities") {
+  std::mt19937 generator(24);
+
+  SECTION("Posteriors are normalized and agree with classification") {
+    for (size_t image_size : {4, 28}) {
+      naivebayes::Data data(image_size);
+      std::vector<size_t> labels;
+      for (size_t i = 0; i < 50; i++) {
+        labels.push_back(generator() % 5 * 2);
+      }
+      AddRandomImages(data, labels, generator);
+      naivebayes::TrainingModel trainer(data);
+      naivebayes::ScoringTables tables = trainer.GetScoringTables();
+      size_t classes = trainer.GetLabels().size();
+
+      std::vector<double> posteriors(classes);
+      for (const naivebayes::Image &image : data.GetImages()) {
+        tables.ComputePosteriors(image.GetWords(), posteriors.data());
+        double sum = 0.0;
+        size_t most_likely = 0;
+        for (size_t c = 0; c < classes; c++) {
+          REQUIRE(std::isfinite(posteriors[c]));
+          REQUIRE(posteriors[c] >= 0.0);
+          sum += posteriors[c];
+          if (posteriors[c] > posteriors[most_likely]) {
+            most_likely = c;
+          }
+        }
+        REQUIRE(sum == Approx(1.0));
+        REQUIRE((int)trainer.GetLabels()[most_likely] ==
+                trainer.Classification(image));
+      }
+    }
+  }
+
+  SECTION("Log posterior ratios match the unnormalized scores") {
+    naivebayes::Data data(4);
+    AddRandomImages(data, {1, 3, 5, 1, 3, 5, 1}, generator);
+    naivebayes::TrainingModel trainer(data);
+    naivebayes::Image image = data.GetImages()[0];
+    std::vector<double> posteriors(3);
+    trainer.GetScoringTables().ComputePosteriors(image.GetWords(),
+                                                 posteriors.data());
+    double first = trainer.Underflow(image.GetImage(), 1);
+    for (size_t c = 1; c < 3; c++) {
+      double other =
+          trainer.Underflow(image.GetImage(), trainer.GetLabels()[c]);
+      REQUIRE(std::log(posteriors[c] / posteriors[0]) ==
+              Approx(other - first).margin(1e-4));
+    }
+  }
+
+  SECTION("Top classes are ordered and padded") {
+    naivebayes::Data data(5);
+    std::vector<size_t> labels;
+    for (size_t i = 0; i < 40; i++) {
+      labels.push_back(i % 6 * 4);
+    }
+    AddRandomImages(data, labels, generator);
+    naivebayes::TrainingModel trainer(data);
+    naivebayes::ScoringTables tables = trainer.GetScoringTables();
+
+    std::vector<double> posteriors(6);
+    naivebayes::ClassProbability top_classes[8];
+    for (const naivebayes::Image &image : data.GetImages()) {
+      tables.ComputePosteriors(image.GetWords(), posteriors.data());
+      REQUIRE(tables.FindTopClasses(image.GetWords(), 3, top_classes) == 3);
+      REQUIRE(top_classes[0].label == trainer.Classification(image));
+      for (size_t i = 0; i < 3; i++) {
+        size_t c = trainer.GetClassIndex().At(top_classes[i].label);
+        REQUIRE(top_classes[i].probability == Approx(posteriors[c]));
+        if (i > 0) {
+          REQUIRE(top_classes[i].probability <=
+                  top_classes[i - 1].probability);
+        }
+      }
+      double third = top_classes[2].probability;
+      size_t above_third = 0;
+      for (double posterior : posteriors) {
+        above_third += posterior > third;
+      }
+      REQUIRE(above_third <= 2);
+
+      REQUIRE(tables.FindTopClasses(image.GetWords(), 8, top_classes) == 6);
+      REQUIRE(top_classes[6].label == -1);
+      REQUIRE(top_classes[7].probability == 0.0);
+    }
+  }
+
+  SECTION("Batches match single images") {
+    naivebayes::Data data(28);
+    AddRandomImages(data, {0, 1, 2, 3, 0, 1, 2, 3, 9}, generator);
+    naivebayes::TrainingModel trainer(data);
+    naivebayes::Classifier classifier(trainer);
+    size_t count = data.GetImages().size();
+    size_t classes = trainer.GetLabels().size();
+    const uint64_t *images = data.GetImages()[0].GetWords();
+
+    std::vector<double> posteriors(count * classes);
+    std::vector<naivebayes::ClassProbability> top_classes(count * 2);
+    classifier.ComputePosteriorsBatch(images, count, posteriors.data());
+    classifier.FindTopClassesBatch(images, count, 2, top_classes.data());
+
+    std::vector<double> single(classes);
+    naivebayes::ClassProbability single_top[2];
+    for (size_t i = 0; i < count; i++) {
+      naivebayes::Image image = data.GetImages()[i];
+      classifier.ComputePosteriors(image, single.data());
+      REQUIRE(std::equal(single.begin(), single.end(),
+                         posteriors.begin() + i * classes));
+      classifier.FindTopClasses(image, 2, single_top);
+      for (size_t j = 0; j < 2; j++) {
+        REQUIRE(top_classes[i * 2 + j].label == single_top[j].label);
+        REQUIRE(top_classes[i * 2 + j].probability ==
+                single_top[j].probability);
+      }
+    }
+  }
+}
+
+TEST_CASE("Branch and Bound Classification") {
+  std::mt19937 generator(25);
+
+  SECTION("Labels match the exhaustive scoring tables") {
+    for (size_t image_size : {3, 6, 28}) {
+      naivebayes::Data data(image_size);
+      std::vector<size_t> labels;
+      for (size_t i = 0; i < 300; i++) {
+        labels.push_back(generator() % 40 * 3);
+      }
+      AddRandomImages(data, labels, generator);
+      naivebayes::TrainingModel trainer(data);
+      naivebayes::ScoringTables tables = trainer.GetScoringTables();
+      naivebayes::BranchAndBoundModel model(tables);
+      naivebayes::Classifier classifier(trainer);
+
+      naivebayes::Data unseen(image_size);
+      AddRandomImages(unseen, std::vector<size_t>(100, 0), generator);
+      for (const naivebayes::Data *set : {&data, &unseen}) {
+        for (const naivebayes::Image &image : set->GetImages()) {
+          int expected = tables.Classify(image.GetWords());
+          REQUIRE(model.Classify(image.GetWords()) == expected);
+          REQUIRE(classifier.ClassifyBranchAndBound(image) == expected);
+        }
+      }
+    }
+  }
+
+  SECTION("Most classes are dropped early") {
+    // each class is a noisy copy of its own random prototype
+    size_t image_size = 28;
+    size_t number_of_classes = 200;
+    std::vector<std::vector<std::vector<size_t>>> prototypes;
+    for (size_t c = 0; c < number_of_classes; c++) {
+      naivebayes::Data prototype(image_size);
+      AddRandomImages(prototype, {c}, generator);
+      prototypes.push_back(prototype.GetImages()[0].GetImage());
+    }
+    naivebayes::Data data(image_size);
+    for (size_t i = 0; i < 4 * number_of_classes; i++) {
+      std::vector<std::vector<size_t>> pixels =
+          prototypes[i % number_of_classes];
+      for (auto &row : pixels) {
+        for (size_t &pixel : row) {
+          if (generator() % 20 == 0) {
+            pixel = pixel == Pixel::kShadedPixel ? Pixel::kUnshadedPixel
+                                                 : Pixel::kShadedPixel;
+          }
+        }
+      }
+      data.AddImage(i % number_of_classes, pixels);
+    }
+    naivebayes::TrainingModel trainer(data);
+    naivebayes::ScoringTables tables = trainer.GetScoringTables();
+    naivebayes::BranchAndBoundModel model(tables);
+
+    size_t pixels_scanned = 0;
+    for (const naivebayes::Image &image : data.GetImages()) {
+      naivebayes::BranchAndBoundStats stats;
+      REQUIRE(model.Classify(image.GetWords(), &stats) ==
+              tables.Classify(image.GetWords()));
+      pixels_scanned += stats.pixels_scanned;
+    }
+    REQUIRE(pixels_scanned <
+            data.GetImages().size() * image_size * image_size / 2);
+  }
+
+  SECTION("Ties go to the lower class index") {
+    naivebayes::Data data(5);
+    naivebayes::Data twin(5);
+    AddRandomImages(data, {7, 7, 7}, generator);
+    for (const naivebayes::Image &image : data.GetImages()) {
+      twin.AddImage(2, image.GetImage());
+    }
+    for (const naivebayes::Image &image : twin.GetImages()) {
+      data.AddImage(2, image.GetImage());
+    }
+    naivebayes::TrainingModel trainer(data);
+    naivebayes::BranchAndBoundModel model(trainer.GetScoringTables());
+    for (const naivebayes::Image &image : data.GetImages()) {
+      naivebayes::BranchAndBoundStats stats;
+      REQUIRE(model.Classify(image.GetWords(), &stats) == 2);
+      REQUIRE(stats.classes_rescored == 2);
+    }
+  }
+
+  SECTION("Pixels are scanned from the most discriminative") {
+    naivebayes::Data data(6);
+    AddRandomImages(data, {1, 2, 3, 1, 2, 3}, generator);
+    naivebayes::TrainingModel trainer(data);
+    naivebayes::ScoringTables tables = trainer.GetScoringTables();
+    naivebayes::BranchAndBoundModel model(tables);
+
+    std::vector<size_t> order = model.GetPixelOrder();
+    auto spread = [&tables](size_t pixel) {
+      const float *row =
+          tables.GetInterleavedWeights() + pixel * tables.GetLaneCount();
+      return *std::max_element(row, row + 3) - *std::min_element(row, row + 3);
+    };
+    for (size_t k = 1; k < order.size(); k++) {
+      REQUIRE(spread(order[k - 1]) >= spread(order[k]));
+    }
+    std::sort(order.begin(), order.end());
+    for (size_t p = 0; p < order.size(); p++) {
+      REQUIRE(order[p] == p);
+    }
+  }
+}
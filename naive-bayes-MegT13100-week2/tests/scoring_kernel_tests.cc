@@ -0,0 +1,83 @@
+#include <catch2/catch.hpp>
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <core/scoring_kernel.h>
+
+using naivebayes::ScoringKernel;
+
+namespace {
+
+// Runs one kernel over a random weight table and row list.
+std::vector<float> RunKernel(ScoringKernel kernel, size_t stride,
+                             const std::vector<float> &weights,
+                             const std::vector<size_t> &rows) {
+  std::vector<float> scores(stride);
+  for (size_t lane = 0; lane < stride; lane++) {
+    scores[lane] = -0.5f * lane;
+  }
+  naivebayes::GetScoringKernel(kernel)(weights.data(), stride, rows.data(),
+                                       rows.size(), scores.data());
+  return scores;
+}
+
+}
+
+TEST_CASE("Scoring Kernels") {
+  std::mt19937 generator(126);
+  std::uniform_real_distribution<float> weight(-4.0f, 4.0f);
+
+  SECTION("Padded lane count") {
+    REQUIRE(naivebayes::PaddedLaneCount(1) == 8);
+    REQUIRE(naivebayes::PaddedLaneCount(8) == 8);
+    REQUIRE(naivebayes::PaddedLaneCount(10) == 16);
+  }
+
+  SECTION("Scalar kernel adds rows lane by lane") {
+    std::vector<float> weights(3 * 8);
+    for (size_t i = 0; i < weights.size(); i++) {
+      weights[i] = (float)i;
+    }
+    std::vector<size_t> rows {2, 0, 2};
+    std::vector<float> scores =
+        RunKernel(naivebayes::kScalarKernel, 8, weights, rows);
+    REQUIRE(scores[0] == Approx(32.0));
+    REQUIRE(scores[7] == Approx(-3.5 + 23 + 7 + 23));
+  }
+
+  SECTION("Vector kernels are bit-exact with the scalar kernel") {
+    const ScoringKernel kernels[] = {naivebayes::kSse42Kernel,
+                                     naivebayes::kAvx2Kernel};
+    const size_t number_of_pixels = 784;
+    for (size_t stride : {8, 16, 24, 40}) {
+      std::vector<float> weights(number_of_pixels * stride);
+      for (float &w : weights) {
+        w = weight(generator);
+      }
+      std::vector<size_t> rows;
+      for (size_t pixel = 0; pixel < number_of_pixels; pixel++) {
+        if (generator() % 5 == 0) {
+          rows.push_back(pixel);
+        }
+      }
+
+      std::vector<float> expected =
+          RunKernel(naivebayes::kScalarKernel, stride, weights, rows);
+      for (ScoringKernel kernel : kernels) {
+        if (!naivebayes::IsScoringKernelSupported(kernel)) {
+          continue;
+        }
+        std::vector<float> actual = RunKernel(kernel, stride, weights, rows);
+        REQUIRE(std::memcmp(actual.data(), expected.data(),
+                            stride * sizeof(float)) == 0);
+      }
+    }
+  }
+
+  SECTION("Best kernel is supported") {
+    REQUIRE(naivebayes::IsScoringKernelSupported(
+        naivebayes::GetBestScoringKernel()));
+  }
+}